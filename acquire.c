@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 
 /* local objects */
 #include "error.h"
@@ -17,8 +18,52 @@
   This object contains one event loop, that drives
   the data aquisition thread.  Maintaining connection
   statefulness and retrieving all data is done here.
+  With PIPELINE set, a second thread checks and
+  decodes each cycle while the next is requested.
 ****************************************************/
 
+/* hands finished cycles from the acq loop to the decode thread.  the acq
+   loop receives into each packet's rxdata, and at the end of a cycle swaps
+   it with data, which the decode thread then owns until it's done. */
+typedef struct _acq_pipe_t {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int busy;      /* a cycle has been handed off and isn't decoded yet */
+  int *received; /* per packet, received this cycle, acq loop only */
+  int *pending;  /* per packet, handed off for checking and decoding */
+  int *failed;   /* per packet, failed its checks, cleared at the handoff */
+  int good;      /* packets that passed their checks, since the last handoff */
+  unsigned int generation; /* bumped when the connection drops, a cycle
+                              handed off before that is stale */
+  pthread_t thread;
+} acq_pipe_t;
+
+acq_pipe_t acqpipe;
+
+/* check the header and checksum of a received packet, as configured.
+   counts any failure in the stats, and returns 1 if the packet is good. */
+int acq_check_packet(aldl_conf_t *aldl, aldl_packetdef_t *pkt, byte *data);
+
+/* count a failed packet, and assume desync after too many in a row */
+void acq_packet_failed(aldl_conf_t *aldl);
+
+/* start the decode thread */
+void acq_pipe_start(aldl_conf_t *aldl);
+
+/* discard the cycle being received, and wait for the decode thread to finish
+   or abandon the one it has, before a reconnect.  anything it hasn't checked
+   yet is stale, and neither counted in the stats nor decoded. */
+void acq_pipe_flush(aldl_conf_t *aldl);
+
+/* hand the packets received this cycle to the decode thread, waiting for it
+   to finish the previous cycle first.  any packet that failed its checks
+   there is made due again next cycle in freq_counter.  returns the number of
+   packets that passed their checks since the last handoff. */
+int acq_pipe_handoff(aldl_conf_t *aldl, int *freq_counter);
+
+/* the decode thread */
+void *acq_pipe_thread(void *aldl_in);
+
 void *aldl_acq(void *aldl_in) {
   #ifdef VERBLOSITY
   printf("aldl_acq thread active\n");
@@ -63,6 +108,8 @@ void *aldl_acq(void *aldl_in) {
   int pktcounter = 0; /* how many packets between timestamps */
   #endif
 
+  if(aldl->pipeline == 1) acq_pipe_start(aldl);
+
   /* intial connection state */
   set_connstate(ALDL_CONNECTING,aldl);
 
@@ -96,6 +143,7 @@ void *aldl_acq(void *aldl_in) {
     /* handle serial error */
     if(serial_get_status() != 1) {
       set_connstate(ALDL_SERIALERROR,aldl);
+      if(aldl->pipeline == 1) acq_pipe_flush(aldl);
       while (serial_get_status() != 1) {
         /* keep track of how long we're down, since we're outside of lagcheck
            loop. */
@@ -112,8 +160,12 @@ void *aldl_acq(void *aldl_in) {
     /* this would seem an appropriate time to maintain the connection if it
        drops, or if it never existed ... if not, time for a delay */
     if(get_connstate(aldl) >= 10) { /* if in any sort of disconnected state */
+      if(aldl->pipeline == 1) acq_pipe_flush(aldl);
       aldl_reconnect(comm); /* main connection happens here */
+      lock_stats();
+      aldl->stats->failcounter = 0; /* fails before the drop don't count */
       set_connstate(ALDL_CONNECTED,aldl);
+      unlock_stats();
     #ifndef AGGRESSIVE
     } else {
       /* delay between data collection iterations */
@@ -156,7 +208,7 @@ void *aldl_acq(void *aldl_in) {
       serial_write(auxcommand->command, auxcommand->length);
       #endif
       msleep(auxcommand->delay);
-      serial_purge(); /* flush after delay to discard? */
+      rx_purge(); /* flush after delay to discard? */
       /* FIXME need more logic, maybe callbacks? */
       free(auxcommand->command);
       free(auxcommand);
@@ -175,56 +227,25 @@ void *aldl_acq(void *aldl_in) {
       #ifdef VERBLOSITY
       printf("packet %i failed due to timeout...\n",npkt);
       #endif
-
-    /* optional check for pcm address bit in the header, to see if we're
-       even in the ballpark of a legit packet.  this may avoid an expensive
-       checksumming run if the packet is total garbage. */
-    #ifdef CHECK_HEADER_SANITY
-    } else if (pkt->data[0] != comm->pcm_address ||
-       pkt->data[1] != calc_msglength(pkt->length)) {
+    } else if(aldl->pipeline == 1) {
+      /* checked by the decode thread, while the next one is requested */
+      acqpipe.received[npkt] = 1;
+    } else if(acq_check_packet(aldl,pkt,pkt->data) == 0) {
       pktfail = 1;
-      lock_stats();
-      aldl->stats->packetheaderfail++;
-      unlock_stats();
-      #ifdef VERBLOSITY
-      printf("header failed @ pkt %i...\n",npkt);
-      #endif
-    #endif
-
-    /* verify checksum if that option is enabled in the commdef. */
-    } else if(comm->checksum_enable == 1 &&
-       checksum_test(pkt->data, pkt->length) == 0) {
-      pktfail = 1;
-      lock_stats();
-      aldl->stats->packetchecksumfail++;
-      unlock_stats();
-      #ifdef VERBLOSITY
-      printf("checksum failed @ pkt %i...\n",npkt);
-      #endif
     }
 
     /* handle condition of a bad packet */
     if(pktfail == 1) {
-      lock_stats();
-      aldl->stats->failcounter++; /* increment failed pkt counter */
-      #ifdef VERBLOSITY
-      printf("packet fail counter: %i\n",aldl->stats->failcounter);
-      #endif
-
-      /* --- set a desync state if we're getting lots of fails in a row */
-      if(aldl->stats->failcounter > aldl->maxfail) {
-        set_connstate(ALDL_DESYNC,aldl);
-      }
-      unlock_stats();
-
+      acq_packet_failed(aldl);
       pktfail = 0; /* reset fail state */
       goto PKTRETRY; /* jump back to earlier in the loop, no increment */
 
     /* packet is good to go */
-    } else {
+    } else if(aldl->pipeline == 0) {
       #ifdef TRACK_PKTRATE
       pktcounter++; /* increment packet counter */
       #endif
+      pkt->dirty = 1; /* mark for decoding by process_data */
       lock_stats();
       aldl->stats->failcounter = 0; /* reset failcounter */
       unlock_stats();
@@ -243,7 +264,15 @@ void *aldl_acq(void *aldl_in) {
     /* all packets should be complete here */
 
     /* process the packet */
-    process_data(aldl);
+    if(aldl->pipeline == 1) {
+      #ifdef TRACK_PKTRATE
+      pktcounter += acq_pipe_handoff(aldl,freq_counter);
+      #else
+      acq_pipe_handoff(aldl,freq_counter);
+      #endif
+    } else {
+      process_data(aldl);
+    }
 
     noquerypkt:
 
@@ -259,3 +288,168 @@ void *aldl_acq(void *aldl_in) {
   return NULL;
 }
 
+int acq_check_packet(aldl_conf_t *aldl, aldl_packetdef_t *pkt, byte *data) {
+  aldl_commdef_t *comm = aldl->comm;
+
+  /* optional check for pcm address bit in the header, to see if we're
+     even in the ballpark of a legit packet.  this may avoid an expensive
+     checksumming run if the packet is total garbage. */
+  #ifdef CHECK_HEADER_SANITY
+  if(data[0] != comm->pcm_address ||
+     data[1] != calc_msglength(pkt->length)) {
+    lock_stats();
+    aldl->stats->packetheaderfail++;
+    unlock_stats();
+    #ifdef VERBLOSITY
+    printf("header failed @ pkt %i...\n",pkt->id);
+    #endif
+    return 0;
+  }
+  #endif
+
+  /* verify checksum if that option is enabled in the commdef. */
+  if(comm->checksum_enable == 1 && checksum_test(data, pkt->length) == 0) {
+    lock_stats();
+    aldl->stats->packetchecksumfail++;
+    unlock_stats();
+    #ifdef VERBLOSITY
+    printf("checksum failed @ pkt %i...\n",pkt->id);
+    #endif
+    return 0;
+  }
+
+  return 1;
+}
+
+void acq_packet_failed(aldl_conf_t *aldl) {
+  lock_stats();
+  aldl->stats->failcounter++; /* increment failed pkt counter */
+  #ifdef VERBLOSITY
+  printf("packet fail counter: %i\n",aldl->stats->failcounter);
+  #endif
+
+  /* --- set a desync state if we're getting lots of fails in a row */
+  if(aldl->stats->failcounter > aldl->maxfail) {
+    set_connstate(ALDL_DESYNC,aldl);
+  }
+  unlock_stats();
+}
+
+void acq_pipe_start(aldl_conf_t *aldl) {
+  int n_packets = aldl->comm->n_packets;
+  acqpipe.busy = 0;
+  acqpipe.good = 0;
+  acqpipe.generation = 0;
+  acqpipe.received = smalloc(sizeof(int) * n_packets);
+  acqpipe.pending = smalloc(sizeof(int) * n_packets);
+  acqpipe.failed = smalloc(sizeof(int) * n_packets);
+  memset(acqpipe.received,0,sizeof(int) * n_packets);
+  memset(acqpipe.pending,0,sizeof(int) * n_packets);
+  memset(acqpipe.failed,0,sizeof(int) * n_packets);
+  pthread_mutex_init(&acqpipe.lock,NULL);
+  pthread_cond_init(&acqpipe.cond,NULL);
+  if(pthread_create(&acqpipe.thread,NULL,acq_pipe_thread,(void *)aldl) != 0) {
+    error(1,ERROR_GENERAL,"couldn't start the decode thread");
+  }
+}
+
+void acq_pipe_flush(aldl_conf_t *aldl) {
+  int x;
+  pthread_mutex_lock(&acqpipe.lock);
+  __atomic_add_fetch(&acqpipe.generation,1,__ATOMIC_SEQ_CST);
+  for(x=0;x<aldl->comm->n_packets;x++) acqpipe.received[x] = 0;
+  while(acqpipe.busy == 1) pthread_cond_wait(&acqpipe.cond,&acqpipe.lock);
+  for(x=0;x<aldl->comm->n_packets;x++) acqpipe.failed[x] = 0;
+  acqpipe.good = 0;
+  pthread_mutex_unlock(&acqpipe.lock);
+}
+
+int acq_pipe_handoff(aldl_conf_t *aldl, int *freq_counter) {
+  aldl_packetdef_t *pkt;
+  byte *swap;
+  int x;
+  int good;
+
+  pthread_mutex_lock(&acqpipe.lock);
+  /* decoding takes far less time than a request, so this rarely waits */
+  while(acqpipe.busy == 1) pthread_cond_wait(&acqpipe.cond,&acqpipe.lock);
+  for(x=0;x<aldl->comm->n_packets;x++) {
+    if(acqpipe.failed[x] == 1) {
+      /* the frequency select routine takes a full counter as due */
+      freq_counter[x] = aldl->comm->packet[x].frequency;
+      acqpipe.failed[x] = 0;
+    }
+    if(acqpipe.received[x] == 0) continue;
+    pkt = &aldl->comm->packet[x];
+    swap = pkt->data;
+    pkt->data = pkt->rxdata;
+    pkt->rxdata = swap;
+    acqpipe.pending[x] = 1;
+    acqpipe.received[x] = 0;
+  }
+  good = acqpipe.good;
+  acqpipe.good = 0;
+  acqpipe.busy = 1;
+  pthread_cond_broadcast(&acqpipe.cond);
+  pthread_mutex_unlock(&acqpipe.lock);
+  return good;
+}
+
+void *acq_pipe_thread(void *aldl_in) {
+  aldl_conf_t *aldl = (aldl_conf_t *)aldl_in;
+  aldl_packetdef_t *pkt;
+  int x;
+  int good, n_pending;
+  int stale; /* the connection dropped since this cycle was handed off */
+  unsigned int generation;
+
+  pthread_mutex_lock(&acqpipe.lock);
+  while(1) {
+    while(acqpipe.busy == 0) pthread_cond_wait(&acqpipe.cond,&acqpipe.lock);
+    generation = acqpipe.generation;
+    pthread_mutex_unlock(&acqpipe.lock);
+
+    /* a packet that fails can't be retried from here, it's left out of this
+       record and its definitions carry forward like any packet that wasn't
+       due.  the acq loop requests it again next cycle. */
+    good = 0;
+    n_pending = 0;
+    stale = 0;
+    for(x=0;x<aldl->comm->n_packets;x++) {
+      if(acqpipe.pending[x] == 0) continue;
+      acqpipe.pending[x] = 0;
+      if(stale == 0 &&
+         __atomic_load_n(&acqpipe.generation,__ATOMIC_SEQ_CST) != generation) {
+        stale = 1;
+      }
+      if(stale == 1) continue; /* drop the rest, it's from before the drop */
+      n_pending++;
+      pkt = &aldl->comm->packet[x];
+      if(acq_check_packet(aldl,pkt,pkt->data) == 1) {
+        pkt->dirty = 1; /* mark for decoding by process_data */
+        good++;
+        lock_stats();
+        aldl->stats->failcounter = 0; /* reset failcounter */
+        unlock_stats();
+      } else {
+        acq_packet_failed(aldl);
+        acqpipe.failed[x] = 1; /* read by the next handoff */
+      }
+    }
+
+    if(stale == 1) {
+      /* nothing from before the drop goes into a record after it */
+      for(x=0;x<aldl->comm->n_packets;x++) aldl->comm->packet[x].dirty = 0;
+      good = 0;
+    } else if(good > 0 || n_pending == 0) {
+      /* a cycle where everything failed has nothing new to record */
+      process_data(aldl);
+    }
+
+    pthread_mutex_lock(&acqpipe.lock);
+    acqpipe.good += good;
+    acqpipe.busy = 0;
+    pthread_cond_broadcast(&acqpipe.cond);
+  }
+  return NULL;
+}
@@ -12,7 +12,14 @@
 
 int aldl_reconnect(); /* go into diagnostic mode, returns 1 on success */
 
-/* fills the data section of the packet def with data, or sets it to zero if
+/* the serial reader thread, drains the serial driver into the rx ring that
+   all of the comms functions read from.  start it once after serial_init. */
+void *rx_thread(void *arg);
+
+/* discard everything received so far, instead of a driver purge */
+void rx_purge();
+
+/* fills the rxdata section of the packet def with data, or sets it to zero if
    fail, and returns NULL */
 byte *aldl_get_packet(aldl_packetdef_t *p);
 
@@ -41,6 +48,10 @@ void aldl_data_init(aldl_conf_t *aldl);
 /* allocate communications static buffer, call in main once and leave it */
 void alloc_commbuf();
 
+/* compile the per-packet decode plans from the definitions, call once after
+   the config is loaded */
+void aldl_compile_plan(aldl_conf_t *aldl);
+
 /* process data from all packets, create a record, and link it to the list */
 aldl_record_t *process_data(aldl_conf_t *aldl);
 
@@ -49,24 +60,54 @@ void init_locks();
 
 /* record selection ---------------------------------------*/
 
-/* return the newest or next record in the linked list.  if there is no such
-   record, return NULL. */
+/* return the newest or next record in the ring.  if there is no such
+   record, return NULL.  these never take a lock. */
 aldl_record_t *newest_record(aldl_conf_t *aldl);
 aldl_record_t *next_record(aldl_record_t *rec);
 
-/* return the newest or next record in the linked list.  if there is no such
+/* return the record before rec, or NULL if it's older than the ring can
+   still hold. */
+aldl_record_t *prev_record(aldl_record_t *rec);
+
+/* return the newest or next record in the ring.  if there is no such
    record, wait forever until one is available, unless the connection to the
    ECM is lost, in which case return NULL. */
 aldl_record_t *newest_record_wait(aldl_conf_t *aldl, aldl_record_t *rec);
 aldl_record_t *next_record_wait(aldl_conf_t *aldl, aldl_record_t *rec);
 
-/* return the newest or next record in the linked list.  if there is no such
+/* return the newest or next record in the ring.  if there is no such
    record, wait forever until one is available.  never return anything but a
    valid record. */
 aldl_record_t *next_record_waitf(aldl_conf_t *aldl, aldl_record_t *rec);
 aldl_record_t *newest_record_waitf(aldl_conf_t *aldl, aldl_record_t *rec);
 
-/* get definition or data array index, returns -1 if not found */
+/* the ring buffer only holds BUFFER records, so a slow reader can have the
+   records it hasn't read yet overwritten.  these functions let a reader
+   notice that instead of silently reading newer data. */
+
+/* like next_record_wait, but follows the reader's own sequence number in
+   *seq rather than the one stored in the slot.  on return *seq is the
+   sequence number of the returned record.  if the reader was lapped, the
+   number of records it missed is added to *lost and it is resynced to the
+   oldest intact record. */
+aldl_record_t *next_record_wait_seq(aldl_conf_t *aldl, unsigned long *seq,
+                                    unsigned long *lost);
+
+/* returns 1 if rec still holds record number seq.  check this after reading
+   the data; if it fails, the data may have been partly overwritten. */
+int record_intact(aldl_record_t *rec, unsigned long seq);
+
+/* record data access ------------------------------------*/
+
+/* get the value of definition n from a record.  a boolean is returned as 0
+   or 1 in .i */
+aldl_data_t record_get(aldl_conf_t *aldl, aldl_record_t *rec, int n);
+
+/* fill out with the definition index of each error code set in a record, up
+   to max.  returns the number found. */
+int record_errors(aldl_conf_t *aldl, aldl_record_t *rec, int *out, int max);
+
+/* get definition index, returns -1 if not found */
 int get_index_by_name(aldl_conf_t *aldl, char *name);
 
 /* connection state management ----------------------------*/
@@ -32,6 +32,10 @@ typedef enum aldl_state {
 
 typedef unsigned char byte;
 
+/* booleans in a record are packed into words of this many bits */
+
+#define ALDL_WORDBITS 32
+
 /* aux command */
 
 typedef struct aldl_comq {
@@ -69,6 +73,8 @@ typedef struct aldl_define {
   /* ----- conversion ----------------------------------*/
   aldl_data_t adder;         /* forms a linear equation, such as */ 
   aldl_data_t multiplier;    /* MULTIPLIER(n)+ADDER */ 
+  aldl_data_t *table;        /* 8 bit int/float only, all 256 possible outputs
+                                precomputed incl. clamp, otherwise NULL */
   /* ----- input definition --------------------------- */
   byte packet; /* selects which packet unique id the data comes from */
   byte offset; /* offset within packet in bytes */
@@ -77,20 +83,55 @@ typedef struct aldl_define {
   byte binary; /* offset in bits.  only works for 1 bit fields */
   byte invert; /* invert (0 means no) */
   byte err;    /* is an error code */
+  /* ----- record storage ------------------------------*/
+  int index;   /* index in a record's data array, or for booleans, the bit
+                  index in its packed bool array.  use record_get(). */
 } aldl_define_t;
 
-/* definition of a record, which is a sequential linked-list type structure,
-   used as a container for a snapshot of data. */
+/* definition of a record, which is a slot in a sequence numbered ring
+   buffer, used as a container for a snapshot of data. */
 
 typedef struct aldl_record {
-  /* WARNING! never traverse the linked list manually, as that would not
-     necessarily be thread-safe ... there are functions for that. */
-  struct aldl_record *next; /* linked list traversal, newer record or NULL */
-  struct aldl_record *prev; /* linked list traversal, older record or NULL */
+  /* WARNING! never index the ring manually, as that would not necessarily be
+     thread-safe ... there are functions for that. */
+  unsigned long seq;        /* sequence number, increments by one per record */
   unsigned long t;          /* timestamp of the record */
-  aldl_data_t *data;        /* pointer to the first data record. */
+  aldl_data_t *data;        /* pointer to the first data record, booleans are
+                               not stored here. */
+  unsigned int *bits;       /* packed booleans, ALDL_WORDBITS per word */
 } aldl_record_t;
 
+/* a decode plan is compiled from the definitions at load time, it groups
+   definitions by packet and by kind, so each kind can be decoded by a tight
+   loop with no per-definition type or size switching. */
+
+typedef enum aldl_decodekind {
+  DECODE_LUT8 = 0,  /* any 8 bit int or float, via the definition table */
+  DECODE_INT16 = 1,
+  DECODE_FLOAT16 = 2,
+  DECODE_BOOL = 3,
+  N_DECODEKINDS = 4
+} aldl_decodekind_t;
+
+/* one definition in a decode plan, everything the kernel needs is copied in
+   here so it doesn't touch the (much larger) definition structure */
+
+typedef struct aldl_decodeop {
+  int index;               /* output data index, or bit index for bools */
+  int offset;              /* byte offset in the raw packet, incl. header */
+  aldl_data_t multiplier;  /* linear conversion, MULTIPLIER(n)+ADDER */
+  aldl_data_t adder;
+  aldl_data_t min, max;    /* clamp range, widened to a no-op if MINMAX=0 */
+  aldl_data_t *table;      /* lut8 only, the definition's lookup table */
+  byte bit;                /* bools only, bit position after byteorder */
+  byte invert;             /* bools only, xor with the bit */
+} aldl_decodeop_t;
+
+typedef struct aldl_decodeplan {
+  int n[N_DECODEKINDS];              /* number of ops of each kind */
+  aldl_decodeop_t *op[N_DECODEKINDS]; /* arrays of ops of each kind */
+} aldl_decodeplan_t;
+
 /* defines each packet of data and how to retrieve it */
 
 typedef struct aldl_packetdef {
@@ -100,6 +141,14 @@ typedef struct aldl_packetdef {
   int offset;     /* the offset of the data in bytes, aka header size */
   int frequency;  /* retrieval frequency, or 0 to disable packet */
   byte *data;     /* pointer to the raw data buffer */
+  byte *rxdata;   /* buffer replies are received into.  the same as data,
+                     unless acquisition is pipelined, where they're swapped
+                     when the packet is handed off for decoding. */
+  int n_defs;     /* number of definitions sourced from this packet */
+  int *def;       /* array of definition indexes sourced from this packet */
+  int dirty;      /* set by the acq loop when data has been refreshed since
+                     the last record was processed */
+  aldl_decodeplan_t plan; /* compiled decode plan for this packet */
 } aldl_packetdef_t;
 
 /* master definition of a communication spec for an ECM. */
@@ -135,16 +184,24 @@ typedef struct aldl_stats {
 
 /* an info structure defining aldl communications and data mgmt */
 
+struct _rf_hash_t; /* see useful.h */
+
 typedef struct aldl_conf {
   /* settings ------------ */
   char *serialstr; /* string to init serial port */
   int n_defs;   /* number of definitions */
+  int n_data;   /* number of non-boolean definitions, in each record's data */
+  int n_bools;  /* number of boolean definitions, packed into ... */
+  int n_boolwords; /* ... this many words of each record's bits */
+  unsigned int *errmask; /* n_boolwords mask of bools that are error codes */
+  int *booldef; /* definition index of each packed boolean bit */
   int bufsize;  /* the minimum number of records to maintain */
   int bufstart; /* start plugins when this many records are present */
   int rate;     /* slow down data collection, in microseconds. */
   int maxfail;  /* maximum packet retrieve fails before it's assumed that the
                    connection is no longer stable */
   int minmax;   /* enforce min/max values during conversion */
+  int pipeline; /* decode on a separate thread, overlapped with requests */
   /* plugin enables -------*/
   int mode4_enable; /* a special mode ... */
   int consoleif_enable;
@@ -158,6 +215,7 @@ typedef struct aldl_conf {
   /* structures -----------*/
   aldl_state_t state;   /* connection state, do not touch */
   aldl_define_t *def;   /* link to the definition set */
+  struct _rf_hash_t *defindex; /* definition index by name */
   aldl_record_t *r;     /* link to the latest record */
   aldl_commdef_t *comm; /* link back to the communication spec */
   aldl_stats_t *stats;  /* statistics */
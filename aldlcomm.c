@@ -4,6 +4,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "error.h"
 #include "serio.h"
@@ -24,12 +25,24 @@
 
 byte *commbuf;
 
+/* the rx ring, filled by rx_thread.  positions count every byte ever
+   received, so they never wrap; position p lives at p % ALDL_RXBUFFER. */
+byte *rxbuf;
+timespec_t *rxtime; /* arrival time of each byte in rxbuf */
+unsigned long rxhead; /* bytes received, only written by rx_thread */
+unsigned long rxcursor; /* next byte to be consumed */
+unsigned long rxoverrun; /* bytes lost because the consumer fell behind */
+pthread_mutex_t rxlock; /* protects everything above */
+pthread_cond_t rxcond; /* signalled when bytes arrive */
+
 /* local functions -----*/
 
 int aldl_shutup(); /* repeatedly attempt to make the ecm shut up */
 
 int aldl_waitforchatter(); /* waits forever for a byte, then bails */
 
+int aldl_waitforquiet(); /* waits for a gap in traffic, drops what arrives */
+
 int aldl_timeout(int len); /* figure out a timeout period */
 
 /************ FUNCTIONS **********************/
@@ -44,7 +57,7 @@ int aldl_reconnect(aldl_commdef_t *c) {
        unless the ecm has idle traffic ... */
     if(aldl_shutup(c) == 1) serial_write(c->returncommand,4);
     msleep(50);
-    serial_purge();
+    rx_purge();
     if(c->chatterwait == 1) {
       aldl_waitforchatter(c);
     } else {
@@ -53,11 +66,11 @@ int aldl_reconnect(aldl_commdef_t *c) {
     if(aldl_shutup(c) == 1) {
       /* a delay here seems necessary ... */
       msleep(50);
-      serial_purge();
+      rx_purge();
       return 1;
     } else { /* shutup request failed */
       msleep(50);
-      serial_purge();
+      rx_purge();
     }
   }
   return 0;
@@ -89,15 +102,27 @@ int aldl_waitforchatter(aldl_commdef_t *c) {
 }
 
 int aldl_request(byte *pkt, int len) {
-  serial_purge();
+  rx_purge();
   serial_write(pkt,len);
-  #ifndef AGGRESSIVE
-  msleep(aldl_timeout(len));
-  #endif
-  int result = listen_bytes(pkt,len,len,aldl_timeout(len));
+  /* the echo takes about aldl_timeout to come back, allow it that again.
+     a purge only drops what has already arrived, so allow for a stray byte
+     or two still on the wire ahead of it. */
+  int result = listen_bytes(pkt,len,len * 2,aldl_timeout(len) * 2);
+  /* a late echo still has its reply behind it, and the next request would
+     be sent over the top of that, and miss its own echo the same way. */
+  if(result == 0) aldl_waitforquiet();
   return result;
 }
 
+int aldl_waitforquiet() {
+  timespec_t giveup = get_deadline(ALDL_QUIETMAX);
+  while(get_remaining_us(giveup) > 0) {
+    if(rx_read_until(commbuf,ALDL_COMMBUFFER,
+                     get_deadline(ALDL_QUIETGAP)) == 0) return 1;
+  }
+  return 0; /* never went quiet, probably idle chatter */
+}
+
 int aldl_timeout(int len) {
   int timeout = ( len * SERIAL_BYTES_PER_MS ) + ( len * ECMLAGTIME );
   /* if the timeout is too short, set it higher */
@@ -117,32 +142,35 @@ int aldl_shutup(aldl_commdef_t *c) {
 byte *aldl_get_packet(aldl_packetdef_t *p) {
   if(aldl_request(p->command, 5) == 0) return NULL;
   /* get actual data */
-  if(read_bytes(p->data, p->length, aldl_timeout(p->length)) == 0) {
+  if(read_bytes(p->rxdata, p->length, aldl_timeout(p->length)) == 0) {
     /* failed to get data */
-    memset(p->data,0,p->length);
+    memset(p->rxdata,0,p->length);
     return NULL;
   }
-  return p->data;
+  return p->rxdata;
 }
 
 inline int read_bytes(byte *str, int bytes, int timeout) {
-  int bytes_read = 0;
-  timespec_t timestamp = get_time();
+  int bytes_read;
   #ifdef SERIAL_VERBOSE
   printf("**READ_BYTES %i bytes %i timeout : ",bytes,timeout);
   #endif
-  do {
-    bytes_read += serial_read(str + bytes_read, bytes - bytes_read);
-    if(bytes_read >= bytes) {
-      #ifdef SERIAL_VERBOSE
-      printhexstring(str,bytes);
-      #endif
-      return 1;
-    }
-    #ifndef AGGRESSIVE
-    usleep(SLEEPYTIME);
+  bytes_read = rx_read_until(str,bytes,get_deadline(timeout));
+  if(bytes_read >= bytes) {
+    #ifdef SERIAL_VERBOSE
+    printhexstring(str,bytes);
+    timespec_t first = rx_arrival(bytes);
+    timespec_t last = rx_arrival(1);
+    printf("READ_BYTES arrived over %li us\n",
+           (last.tv_sec - first.tv_sec) * 1000000 +
+           #ifdef USEFUL_BETTERCLOCK
+           (last.tv_nsec - first.tv_nsec) / 1000);
+           #else
+           (last.tv_usec - first.tv_usec));
+           #endif
     #endif
-  } while (get_elapsed_ms(timestamp) <= timeout);
+    return 1;
+  }
   #ifdef SERIAL_VERBOSE
   printf("TIMEOUT TRYING TO READ %i BYTES, GOT: ",bytes);
   printhexstring(str,bytes_read);
@@ -180,32 +208,40 @@ int listen_bytes(byte *str, int len, int max, int timeout) {
   }
   int chars_read = 0; /* total chars read into buffer */
   int chars_in = 0; /* chars added to buffer */
-  timespec_t timestamp = get_time(); /* timestamp beginning of op */
+  int chars_want; /* chars that could possibly complete a match */
+  timespec_t deadline = get_deadline(timeout); /* end of op */
+  rf_match_t m;
+  rf_match_init(&m,str,len);
   #ifdef SERIAL_VERBOSE
   printf("LISTEN: ");
   printhexstring(str,len);
   #endif
   while(chars_read < max) {
-    chars_in = serial_read(commbuf + chars_read,max - chars_read);
+    /* never read more than could finish the match, so nothing after it is
+       consumed, and wake up as soon as that much has arrived */
+    chars_want = len - m.state;
+    if(chars_want > max - chars_read) chars_want = max - chars_read;
+    if(timeout <= 0) deadline = get_deadline(1000); /* waiting forever */
+    chars_in = rx_read_until(commbuf + chars_read,chars_want,deadline);
     if(chars_in > 0) {
-      chars_read += chars_in; /* mv cursor */
-      if(cmp_bytestring(commbuf,chars_read,str,len) == 1) {
+      /* each byte is only looked at once, the matcher keeps its place */
+      if(rf_match_feed(&m,commbuf + chars_read,chars_in) > 0) {
+        rf_match_free(&m);
         return 1;
       }
+      chars_read += chars_in; /* mv cursor */
     }
-    /* timeout and throttling routine */
-    #ifndef AGGRESSIVE
-    usleep(SLEEPYTIME); /* timing delay */
-    #endif
     if(timeout > 0) { /* timeout is enabled, we arent waiting forever */
-      if(get_elapsed_ms(timestamp) >= timeout) { /* timeout exceeded */
+      if(get_remaining_us(deadline) == 0) { /* timeout exceeded */
         #ifdef SERIAL_VERBOSE
         printf("LISTEN TIMEOUT\n");
         #endif
+        rf_match_free(&m);
         return 0;
       }
     }
   }
+  rf_match_free(&m);
   #ifdef SERIAL_VERBOSE
   printf("STRING NOT FOUND, GOT: ");
   printhexstring(commbuf,chars_read);
@@ -239,4 +275,85 @@ byte *generate_mode(byte mode, aldl_commdef_t *comm) {
 
 void alloc_commbuf() {
   commbuf = smalloc(sizeof(byte) * ALDL_COMMBUFFER);
+
+  rxbuf = smalloc(sizeof(byte) * ALDL_RXBUFFER);
+  rxtime = smalloc(sizeof(timespec_t) * ALDL_RXBUFFER);
+  rxhead = 0;
+  rxcursor = 0;
+  rxoverrun = 0;
+  pthread_mutex_init(&rxlock,NULL);
+  #ifdef USEFUL_BETTERCLOCK
+  /* deadlines are on the monotonic clock, so the wait must be too */
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr,_CLOCKSOURCE);
+  pthread_cond_init(&rxcond,&attr);
+  pthread_condattr_destroy(&attr);
+  #else
+  pthread_cond_init(&rxcond,NULL);
+  #endif
+}
+
+void *rx_thread(void *arg) {
+  byte in;
+  timespec_t t;
+  /* one byte at a time, so each gets its own arrival time.  at ALDL baud
+     rates that's under a thousand reads a second. */
+  while(1) {
+    if(serial_read_until(&in,1,get_deadline(ALDL_RXWAIT)) < 1) continue;
+    t = get_time();
+    pthread_mutex_lock(&rxlock);
+    rxbuf[rxhead % ALDL_RXBUFFER] = in;
+    rxtime[rxhead % ALDL_RXBUFFER] = t;
+    rxhead++;
+    pthread_cond_broadcast(&rxcond);
+    pthread_mutex_unlock(&rxlock);
+  }
+  return NULL;
+}
+
+void rx_purge() {
+  pthread_mutex_lock(&rxlock);
+  rxcursor = rxhead;
+  pthread_mutex_unlock(&rxlock);
+  #ifdef SERIAL_VERBOSE
+  printf("RX PURGE\n");
+  #endif
+}
+
+int rx_read_until(byte *str, int len, timespec_t deadline) {
+  unsigned long avail;
+  int n, x;
+  #ifdef USEFUL_BETTERCLOCK
+  struct timespec until = deadline;
+  #else
+  struct timespec until = { deadline.tv_sec, deadline.tv_usec * 1000 };
+  #endif
+
+  pthread_mutex_lock(&rxlock);
+  while(rxhead - rxcursor < (unsigned long)len) {
+    if(pthread_cond_timedwait(&rxcond,&rxlock,&until) != 0) break;
+  }
+  avail = rxhead - rxcursor;
+  if(avail > ALDL_RXBUFFER) { /* the oldest bytes were overwritten */
+    rxoverrun += avail - ALDL_RXBUFFER;
+    #ifdef SERIAL_VERBOSE
+    printf("RX OVERRUN, lost %lu bytes\n",avail - ALDL_RXBUFFER);
+    #endif
+    rxcursor = rxhead - ALDL_RXBUFFER;
+    avail = ALDL_RXBUFFER;
+  }
+  n = (avail < (unsigned long)len) ? avail : len;
+  for(x=0;x<n;x++) str[x] = rxbuf[(rxcursor + x) % ALDL_RXBUFFER];
+  rxcursor += n;
+  pthread_mutex_unlock(&rxlock);
+  return n;
+}
+
+timespec_t rx_arrival(int back) {
+  timespec_t t;
+  pthread_mutex_lock(&rxlock);
+  t = rxtime[(rxcursor - back) % ALDL_RXBUFFER];
+  pthread_mutex_unlock(&rxlock);
+  return t;
 }
@@ -1,8 +1,8 @@
 #ifndef _ALDLCOMM_H
 #define _ALDLCOMM_H
 
-/* sends a request, delays for a calculated time, and waits for an echo.  if
-   the request is successful, returns 1, otherwise 0. */
+/* sends a request and waits up to a calculated time for an echo.  if the
+   request is successful, returns 1, otherwise 0. */
 int aldl_request(byte *pkt, int len);
 
 /* read the number of bytes specified, into str.  waits until the correct
@@ -18,4 +18,12 @@ inline int skip_bytes(int bytes, int timeout);
    timeout. */
 int listen_bytes(byte *str, int len, int max, int timeout);
 
+/* take up to len bytes from the rx ring, waiting until len bytes are there
+   or the deadline has passed.  returns the number of bytes taken. */
+int rx_read_until(byte *str, int len, timespec_t deadline);
+
+/* arrival time of a byte already taken from the rx ring, counting back from
+   the most recent, which is 1. */
+timespec_t rx_arrival(int back);
+
 #endif
@@ -6,6 +6,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <limits.h>
+#include <math.h>
 
 #include "serio.h"
 #include "config.h"
@@ -33,16 +34,33 @@ typedef enum aldl_lock {
 } aldl_lock_t;
 pthread_mutex_t *aldllock;
 
+/* signalled with LOCK_RECORDPTR held whenever a record is linked or the
+   connection state changes, so waiting readers can sleep instead of poll */
+pthread_cond_t recordcond;
+
+/* number of readers sleeping in wait_record(), the acq thread only takes
+   LOCK_RECORDPTR to wake them if this is nonzero */
+int n_waiting;
+
 timespec_t firstrecordtime; /* timestamp used to calc. relative time */
 
-/* primary memory pool for record storage */
+/* primary memory pool for record storage.  this is a single-writer ring;
+   record n always lives in slot n % poolsize, and is published to readers by
+   an atomic store of headseq, so readers never need a lock to find it. */
 aldl_record_t *recordbuffer; /* circular pool for records */
 aldl_data_t *databuffer; /* circular pool for data */
-unsigned int indexbuffer; /* index for both of above */
+unsigned int *bitbuffer; /* circular pool for packed booleans */
+unsigned int poolsize; /* number of slots in both of above */
+unsigned long recordseq; /* sequence number of the next record to create */
+unsigned long headseq; /* sequence number of the newest linked record */
 
 /* linked list forming a FIFO queue of commands */
 aldl_comq_t *comq;
 
+#ifdef DECODEPLAN_VERIFY
+aldl_record_t verifyrecord; /* scratch record for the reference decoder */
+#endif
+
 /* --------- local function decl. ---------------- */
 
 /* update the value in the record from definition n */
@@ -51,16 +69,36 @@ aldl_data_t *aldl_parse_def(aldl_conf_t *aldl, aldl_record_t *r, int n);
 /* allocate record and timestamp it */
 aldl_record_t *aldl_create_record(aldl_conf_t *aldl);
 
-/* link a prepared record to the linked list */
+/* publish a prepared record as the newest in the ring */
 void link_record(aldl_record_t *rec, aldl_conf_t *aldl);
 
 /* fill a prepared record with data */
 aldl_record_t *aldl_fill_record(aldl_conf_t *aldl, aldl_record_t *rec);
 
+/* run the compiled decode plan for one packet, output to a record */
+void aldl_run_plan(aldl_packetdef_t *pkt, aldl_record_t *rec);
+
+/* decode one packet with aldl_parse_def and compare with the plan output */
+#ifdef DECODEPLAN_VERIFY
+void aldl_verify_plan(aldl_conf_t *aldl, aldl_record_t *rec, int pkt_n);
+#endif
+
 /* set and unset locks, wrapper with error checking for pthread funcs */
 inline void set_lock(aldl_lock_t lock_number);
 inline void unset_lock(aldl_lock_t lock_number);
 
+/* sleep until a record is linked or the connection state changes.
+   LOCK_RECORDPTR must be held, and is held again on return. */
+void wait_record();
+
+/* bracket a wait_record() loop; takes and releases LOCK_RECORDPTR and
+   registers the caller as a waiter so link_record() knows to wake it. */
+void wait_record_begin();
+void wait_record_end();
+
+/* wake any thread sleeping in wait_record() */
+void notify_record();
+
 /* allocate memory pool */
 void aldl_alloc_pool(aldl_conf_t *aldl);
 
@@ -75,6 +113,9 @@ void init_locks() {
     if(pthreaderr != 0) error(1,ERROR_LOCK,
          "error initializing lock %i, pthread error %i",x,pthreaderr);
   }
+  pthreaderr = pthread_cond_init(&recordcond,NULL);
+  if(pthreaderr != 0) error(1,ERROR_LOCK,
+       "error initializing record condition, pthread error %i",pthreaderr);
 }
 
 inline void set_lock(aldl_lock_t lock_number) {
@@ -91,6 +132,33 @@ inline void unset_lock(aldl_lock_t lock_number) {
           "error unsetting lock %i, pthread error code %i",lock_number,rtval);
 }
 
+/* wait on the record condition, LOCK_RECORDPTR must be held */
+void wait_record() {
+  int rtval;
+  rtval = pthread_cond_wait(&recordcond,&aldllock[LOCK_RECORDPTR]);
+  if(rtval != 0) error(1,ERROR_LOCK,
+          "error waiting for record, pthread error code %i",rtval);
+}
+
+void wait_record_begin() {
+  set_lock(LOCK_RECORDPTR);
+  /* must be visible before the caller re-checks the head, pairs with the
+     store/load in link_record() */
+  __atomic_add_fetch(&n_waiting,1,__ATOMIC_SEQ_CST);
+}
+
+void wait_record_end() {
+  __atomic_sub_fetch(&n_waiting,1,__ATOMIC_SEQ_CST);
+  unset_lock(LOCK_RECORDPTR);
+}
+
+/* wake all readers waiting on the record condition */
+void notify_record() {
+  set_lock(LOCK_RECORDPTR);
+  pthread_cond_broadcast(&recordcond);
+  unset_lock(LOCK_RECORDPTR);
+}
+
 void lock_stats() {
   set_lock(LOCK_STATS);
 }
@@ -107,37 +175,37 @@ aldl_record_t *process_data(aldl_conf_t *aldl) {
 }
 
 void link_record(aldl_record_t *rec, aldl_conf_t *aldl) {
-  rec->next = NULL; /* terminate linked list */
-  rec->prev = aldl->r; /* previous link */
-  set_lock(LOCK_RECORDPTR);
-  aldl->r->next = rec; /* attach to linked list */
-  aldl->r = rec; /* fix master link */
-  unset_lock(LOCK_RECORDPTR);
+  /* the record contents must be visible before the new head is, these are
+     sequentially consistent so the n_waiting check below can't be reordered
+     ahead of them, see wait_record_begin().  headseq goes first, so a
+     reader that finds a record through aldl->r never sees an older head */
+  __atomic_store_n(&headseq,rec->seq,__ATOMIC_SEQ_CST);
+  __atomic_store_n(&aldl->r,rec,__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&n_waiting,__ATOMIC_SEQ_CST) > 0) notify_record();
 }
 
 void aldl_data_init(aldl_conf_t *aldl) {
   aldl_alloc_pool(aldl);
   aldl_record_t *rec = aldl_create_record(aldl);
-  set_lock(LOCK_RECORDPTR);
-  rec->next = NULL;
-  rec->prev = NULL;
-  aldl->r = rec;
-  unset_lock(LOCK_RECORDPTR);
+  link_record(rec,aldl);
   firstrecordtime = get_time();
   comq = NULL; /* no records yet */
 }
 
 aldl_record_t *aldl_create_record(aldl_conf_t *aldl) {
   /* get memory pool addresses */
-  aldl_record_t *rec = &recordbuffer[indexbuffer];
-  rec->data = &databuffer[indexbuffer * aldl->n_defs];
+  unsigned int slot = recordseq % poolsize;
+  aldl_record_t *rec = &recordbuffer[slot];
+  rec->data = &databuffer[slot * aldl->n_data];
+  rec->bits = &bitbuffer[slot * aldl->n_boolwords];
 
-  /* advance pool index (for next time around) */
-  if(indexbuffer > aldl->bufsize - 2) { /* end of buffer */
-    indexbuffer = 0; /* return to beginning */
-  } else {
-    indexbuffer++;
-  }
+  /* the sequence number doubles as the slot generation; it must change before
+     any of the old data is overwritten, see record_intact() */
+  __atomic_store_n(&rec->seq,recordseq,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  /* advance sequence (for next time around) */
+  recordseq++;
 
   /* timestamp record */
   rec->t = get_elapsed_ms(firstrecordtime);
@@ -151,14 +219,163 @@ aldl_record_t *aldl_create_record(aldl_conf_t *aldl) {
 }
 
 aldl_record_t *aldl_fill_record(aldl_conf_t *aldl, aldl_record_t *rec) {
-  /* process packet data */
-  int def_n;
-  for(def_n=0;def_n<aldl->n_defs;def_n++) {
-    aldl_parse_def(aldl,rec,def_n);
+  aldl_commdef_t *comm = aldl->comm;
+  aldl_packetdef_t *pkt;
+  int pkt_n;
+  int n_dirty = 0;
+
+  /* count refreshed packets */
+  for(pkt_n=0;pkt_n<comm->n_packets;pkt_n++) {
+    if(comm->packet[pkt_n].dirty == 1) n_dirty++;
+  }
+
+  /* carry forward everything from the previous record, unless it'll all be
+     overwritten anyway.  aldl->r is always the previous record here, since
+     only one thread links records, acq or the pipelined decoder. */
+  if(n_dirty < comm->n_packets) {
+    memcpy(rec->data,aldl->r->data,sizeof(aldl_data_t) * aldl->n_data);
+    memcpy(rec->bits,aldl->r->bits,sizeof(unsigned int) * aldl->n_boolwords);
+  }
+
+  /* decode only definitions sourced from refreshed packets */
+  for(pkt_n=0;pkt_n<comm->n_packets;pkt_n++) {
+    pkt = &comm->packet[pkt_n];
+    if(pkt->dirty == 0) continue;
+    aldl_run_plan(pkt,rec);
+    #ifdef DECODEPLAN_VERIFY
+    aldl_verify_plan(aldl,rec,pkt_n);
+    #endif
+    pkt->dirty = 0;
   }
   return rec;
 }
 
+void aldl_compile_plan(aldl_conf_t *aldl) {
+  aldl_commdef_t *comm = aldl->comm;
+  aldl_packetdef_t *pkt;
+  aldl_define_t *def;
+  aldl_decodeop_t *op;
+  aldl_decodekind_t kind;
+  int pkt_n, def_n, k;
+
+  for(pkt_n=0;pkt_n<comm->n_packets;pkt_n++) {
+    pkt = &comm->packet[pkt_n];
+    /* worst case every definition is the same kind */
+    for(k=0;k<N_DECODEKINDS;k++) {
+      pkt->plan.n[k] = 0;
+      pkt->plan.op[k] = smalloc(sizeof(aldl_decodeop_t) * (pkt->n_defs + 1));
+    }
+    for(def_n=0;def_n<pkt->n_defs;def_n++) {
+      def = &aldl->def[pkt->def[def_n]];
+      switch(def->type) {
+        case ALDL_INT:
+          kind = (def->size == 16) ? DECODE_INT16 : DECODE_LUT8;
+          break;
+        case ALDL_FLOAT:
+          kind = (def->size == 16) ? DECODE_FLOAT16 : DECODE_LUT8;
+          break;
+        case ALDL_BOOL:
+          kind = DECODE_BOOL;
+          break;
+        default:
+          error(1,ERROR_RANGE,"invalid type spec: %i",def->type);
+          return;
+      }
+      op = &pkt->plan.op[kind][pkt->plan.n[kind]];
+      pkt->plan.n[kind]++;
+      op->index = def->index;
+      op->offset = def->offset + pkt->offset;
+      op->multiplier = def->multiplier;
+      op->adder = def->adder;
+      /* with MINMAX off, clamp to a range that can't be exceeded, so the
+         kernels don't need a branch for it */
+      if(def->type == ALDL_FLOAT) {
+        op->min.f = (aldl->minmax == 1) ? def->min.f : -HUGE_VALF;
+        op->max.f = (aldl->minmax == 1) ? def->max.f : HUGE_VALF;
+      } else {
+        op->min.i = (aldl->minmax == 1) ? def->min.i : INT_MIN;
+        op->max.i = (aldl->minmax == 1) ? def->max.i : INT_MAX;
+      }
+      op->bit = (aldl->comm->byteorder == 1) ? 7 - def->binary : def->binary;
+      op->invert = def->invert;
+      op->table = def->table;
+      if(kind == DECODE_LUT8 && op->table == NULL) error(1,ERROR_NULL,
+                                 "no lookup table for def %i",pkt->def[def_n]);
+    }
+    #ifdef DEBUGSTRUCT
+    printf("packet %i plan: %i lut8, %i int16, %i float16, %i bool\n",
+           pkt_n,pkt->plan.n[DECODE_LUT8],pkt->plan.n[DECODE_INT16],
+           pkt->plan.n[DECODE_FLOAT16],pkt->plan.n[DECODE_BOOL]);
+    #endif
+  }
+}
+
+/* clamp without a function call, same semantics as rf_clamp_* */
+#define PLAN_CLAMP(MIN,MAX,IN) ( (IN > MAX) ? MAX : ( (IN < MIN) ? MIN : IN ) )
+
+void aldl_run_plan(aldl_packetdef_t *pkt, aldl_record_t *rec) {
+  byte *data = pkt->data;
+  aldl_data_t *out = rec->data;
+  aldl_decodeop_t *op;
+  int x, n;
+  int v;
+  float f;
+  unsigned int b, mask;
+  unsigned int *word;
+
+  /* 8 bit values are a single table lookup, conversion and clamp included */
+  op = pkt->plan.op[DECODE_LUT8];
+  n = pkt->plan.n[DECODE_LUT8];
+  for(x=0;x<n;x++) {
+    out[op[x].index] = op[x].table[data[op[x].offset]];
+  }
+
+  op = pkt->plan.op[DECODE_INT16];
+  n = pkt->plan.n[DECODE_INT16];
+  for(x=0;x<n;x++) {
+    v = (int)((data[op[x].offset]<<8)|data[op[x].offset + 1]);
+    v = v * op[x].multiplier.i + op[x].adder.i;
+    out[op[x].index].i = PLAN_CLAMP(op[x].min.i,op[x].max.i,v);
+  }
+
+  op = pkt->plan.op[DECODE_FLOAT16];
+  n = pkt->plan.n[DECODE_FLOAT16];
+  for(x=0;x<n;x++) {
+    v = (int)((data[op[x].offset]<<8)|data[op[x].offset + 1]);
+    f = (float)v * op[x].multiplier.f + op[x].adder.f;
+    out[op[x].index].f = PLAN_CLAMP(op[x].min.f,op[x].max.f,f);
+  }
+
+  op = pkt->plan.op[DECODE_BOOL];
+  n = pkt->plan.n[DECODE_BOOL];
+  for(x=0;x<n;x++) {
+    b = getbit(data[op[x].offset],op[x].bit,op[x].invert);
+    word = &rec->bits[op[x].index / ALDL_WORDBITS];
+    mask = 1u << (op[x].index % ALDL_WORDBITS);
+    *word = ( *word & ~mask ) | ( -b & mask ); /* set or clear, no branch */
+  }
+}
+
+#ifdef DECODEPLAN_VERIFY
+void aldl_verify_plan(aldl_conf_t *aldl, aldl_record_t *rec, int pkt_n) {
+  aldl_packetdef_t *pkt = &aldl->comm->packet[pkt_n];
+  int def_n, n;
+  aldl_data_t v;
+  if(verifyrecord.data == NULL) {
+    verifyrecord.data = smalloc(sizeof(aldl_data_t) * aldl->n_defs);
+  }
+  for(def_n=0;def_n<pkt->n_defs;def_n++) {
+    n = pkt->def[def_n];
+    aldl_parse_def(aldl,&verifyrecord,n);
+    v = record_get(aldl,rec,n);
+    if(memcmp(&verifyrecord.data[n],&v,sizeof(aldl_data_t)) != 0) {
+      error(1,ERROR_RANGE,"decode plan mismatch in def %i (%s): %08X vs %08X",
+            n,aldl->def[n].name,verifyrecord.data[n].i,v.i);
+    }
+  }
+}
+#endif
+
 aldl_data_t *aldl_parse_def(aldl_conf_t *aldl, aldl_record_t *r, int n) {
   /* check for out of range */
   if(n < 0 || n > aldl->n_defs - 1) error(1,ERROR_RANGE,
@@ -173,7 +390,9 @@ aldl_data_t *aldl_parse_def(aldl_conf_t *aldl, aldl_record_t *r, int n) {
   /* location of actual data byte */
   byte *data = pkt->data + def->offset + pkt->offset;
 
-  /* location for output of data, matches definition array index ... */
+  /* location for output of data.  this is the reference decoder, which
+     writes an unpacked record indexed by definition number, so it isn't
+     compatible with records in the ring; see aldl_verify_plan */
   aldl_data_t *out = &r->data[n];
 
   /* location for input of data */
@@ -232,92 +451,155 @@ void set_connstate(aldl_state_t s, aldl_conf_t *aldl) {
   #endif
   aldl->state = s;
   unset_lock(LOCK_CONNSTATE);
+  notify_record(); /* waiting readers may need to bail */
 }
 
 aldl_record_t *newest_record(aldl_conf_t *aldl) {
-  aldl_record_t *rec = NULL;
-  set_lock(LOCK_RECORDPTR);
-  rec = aldl->r; 
-  unset_lock(LOCK_RECORDPTR);
-  return rec;
+  return __atomic_load_n(&aldl->r,__ATOMIC_ACQUIRE);
 }
 
 aldl_record_t *newest_record_wait(aldl_conf_t *aldl, aldl_record_t *rec) {
-  aldl_record_t *next = NULL;
-  while(1) {
-    next = newest_record(aldl);
-    if(next != rec) {
-      return next;
-    } else if(get_connstate(aldl) > 10) {
-      return NULL;
-    } else {
-      #ifndef AGGRESSIVE
-      usleep(500);
-      #endif
+  aldl_record_t *next = newest_record(aldl);
+  if(next != rec) return next; /* fast path, no locking */
+  wait_record_begin();
+  while((next = __atomic_load_n(&aldl->r,__ATOMIC_SEQ_CST)) == rec) {
+    if(get_connstate(aldl) > 10) {
+      next = NULL;
+      break;
     }
-  } 
+    wait_record();
+  }
+  wait_record_end();
+  return next;
 }
 
 aldl_record_t *next_record_wait(aldl_conf_t *aldl, aldl_record_t *rec) {
-  aldl_record_t *next = NULL;
-  while(next == NULL) {
-    next = next_record(rec);
-    if(get_connstate(aldl) > 10) return NULL;
-    #ifndef AGGRESSIVE
-    usleep(500); /* throttling ... */
-    #endif
+  aldl_record_t *next = next_record(rec);
+  if(next != NULL) return next; /* fast path, no locking */
+  wait_record_begin();
+  while((next = next_record(rec)) == NULL) {
+    if(get_connstate(aldl) > 10) break;
+    wait_record();
   }
+  wait_record_end();
   return next;
 }
 
 aldl_record_t *next_record_waitf(aldl_conf_t *aldl, aldl_record_t *rec) {
-  aldl_record_t *next = NULL;
-  while((next = next_record_wait(aldl,rec)) == NULL) usleep(500);
+  aldl_record_t *next = next_record(rec);
+  if(next != NULL) return next;
+  wait_record_begin();
+  while((next = next_record(rec)) == NULL) wait_record();
+  wait_record_end();
   return next;
 }
 
 aldl_record_t *newest_record_waitf(aldl_conf_t *aldl, aldl_record_t *rec) {
-  aldl_record_t *next = NULL;
-  while((next = newest_record_wait(aldl,rec)) == NULL) usleep(500);
+  aldl_record_t *next = newest_record(aldl);
+  if(next != rec) return next;
+  wait_record_begin();
+  while((next = __atomic_load_n(&aldl->r,__ATOMIC_SEQ_CST)) == rec) {
+    wait_record();
+  }
+  wait_record_end();
   return next;
 }
 
 aldl_record_t *next_record(aldl_record_t *rec) {
-  #ifdef DEBUGSTRUCT
-  /* check for underrun ... */
-  if(rec->prev == NULL) {
-     error(1,ERROR_BUFFER,"underrun in record retrieve %p",rec);
+  unsigned long seq = rec->seq + 1;
+  /* seq_cst rather than acquire, as this is also the re-check in the wait
+     loops above */
+  if(rec->seq >= __atomic_load_n(&headseq,__ATOMIC_SEQ_CST)) return NULL;
+  return &recordbuffer[seq % poolsize];
+}
+
+aldl_record_t *next_record_wait_seq(aldl_conf_t *aldl, unsigned long *seq,
+                                    unsigned long *lost) {
+  unsigned long want = *seq + 1;
+  unsigned long head = __atomic_load_n(&headseq,__ATOMIC_ACQUIRE);
+  unsigned long oldest;
+  if(head < want) { /* nothing new yet */
+    wait_record_begin();
+    while((head = __atomic_load_n(&headseq,__ATOMIC_SEQ_CST)) < want) {
+      if(get_connstate(aldl) > 10) {
+        wait_record_end();
+        return NULL;
+      }
+      wait_record();
+    }
+    wait_record_end();
   }
-  #endif
-  aldl_record_t *next;
-  set_lock(LOCK_RECORDPTR);
-  next = rec->next;
-  unset_lock(LOCK_RECORDPTR);
-  return next;
+  /* the oldest slot that isn't about to be overwritten by the acq thread */
+  oldest = (head > poolsize - 2) ? head - (poolsize - 2) : 0;
+  if(want < oldest) { /* lapped, resync to the oldest intact record */
+    *lost += oldest - want;
+    want = oldest;
+  }
+  *seq = want;
+  return &recordbuffer[want % poolsize];
+}
+
+int record_intact(aldl_record_t *rec, unsigned long seq) {
+  /* pairs with the fence in aldl_create_record(), if any overwritten data
+     was read then the new sequence number is visible here too */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(__atomic_load_n(&rec->seq,__ATOMIC_RELAXED) != seq) return 0;
+  return 1;
+}
+
+aldl_record_t *prev_record(aldl_record_t *rec) {
+  unsigned long head = __atomic_load_n(&headseq,__ATOMIC_ACQUIRE);
+  if(rec->seq == 0) return NULL; /* first record */
+  /* the oldest slot is the one the acq thread is about to overwrite */
+  if(head - (rec->seq - 1) >= poolsize - 1) return NULL;
+  return &recordbuffer[(rec->seq - 1) % poolsize];
 }
 
 void pause_until_connected(aldl_conf_t *aldl) {
-  while(get_connstate(aldl) > 10) {
-    #ifdef AGGRESSIVE
-      usleep(100);
-    #else
-      msleep(100);
-    #endif
-  }
+  wait_record_begin();
+  while(get_connstate(aldl) > 10) wait_record();
+  wait_record_end();
 }
 
 void pause_until_buffered(aldl_conf_t *aldl) {
-  while(aldl->ready ==0) {
-    #ifdef AGGRESSIVE
-      usleep(100);
-    #else
-      msleep(100); 
-    #endif
+  /* the ready flag is raised by the acq thread just after linking a record,
+     so this may sleep for one extra record period at most */
+  wait_record_begin();
+  while(__atomic_load_n(&aldl->ready,__ATOMIC_SEQ_CST) == 0) wait_record();
+  wait_record_end();
+}
+
+aldl_data_t record_get(aldl_conf_t *aldl, aldl_record_t *rec, int n) {
+  aldl_define_t *def = &aldl->def[n];
+  aldl_data_t out;
+  if(def->type == ALDL_BOOL) {
+    out.i = ( rec->bits[def->index / ALDL_WORDBITS] >>
+                            ( def->index % ALDL_WORDBITS ) ) & 0x01;
+    return out;
+  }
+  return rec->data[def->index];
+}
+
+int record_errors(aldl_conf_t *aldl, aldl_record_t *rec, int *out, int max) {
+  int w, b;
+  int found = 0;
+  unsigned int set;
+  for(w=0;w<aldl->n_boolwords;w++) {
+    set = rec->bits[w] & aldl->errmask[w]; /* a whole word of flags at once */
+    while(set != 0) {
+      if(found >= max) return found;
+      b = __builtin_ctz(set); /* lowest set bit */
+      out[found] = aldl->booldef[w * ALDL_WORDBITS + b];
+      found++;
+      set &= set - 1; /* clear lowest set bit */
+    }
   }
+  return found;
 }
 
 int get_index_by_name(aldl_conf_t *aldl, char *name) {
   int x;
+  if(aldl->defindex != NULL) return rf_hash_get(aldl->defindex,name);
   for(x=0;x<aldl->n_defs;x++) {
     if(rf_strcmp(name,aldl->def[x].name) == 1) return x;
   }
@@ -351,18 +633,24 @@ char *get_state_string(aldl_state_t s) {
 
 void aldl_alloc_pool(aldl_conf_t *aldl) {
   /* get sizes */
-  size_t databuffer_size = sizeof(aldl_data_t) * aldl->n_defs * aldl->bufsize;
+  size_t databuffer_size = sizeof(aldl_data_t) * aldl->n_data * aldl->bufsize;
+  size_t bitbuffer_size = sizeof(unsigned int) * aldl->n_boolwords *
+                          aldl->bufsize;
   size_t recordbuffer_size = sizeof(aldl_record_t) * aldl->bufsize;
 
   /* alloc */
   databuffer = smalloc(databuffer_size);
+  bitbuffer = smalloc(bitbuffer_size + sizeof(unsigned int));
   recordbuffer = smalloc(recordbuffer_size);
-  indexbuffer = 0; /* start at ptr 0 */
+  poolsize = aldl->bufsize;
+  recordseq = 0; /* start at ptr 0 */
+  headseq = 0;
 
   /* optional print sizes */
   #ifdef DEBUGMEM
-  printf("aldldata.c Circular Buffer: BUF=%u Recs, DATA=%uKb REC=%uKb\n",
+  printf("aldldata.c Circular Buffer: BUF=%u Recs, DATA=%uKb BITS=%uKb REC=%uKb\n",
           aldl->bufsize, (unsigned int)databuffer_size/1024,
+         (unsigned int)bitbuffer_size/1024,
          (unsigned int)recordbuffer_size/1024);
   #endif
 }
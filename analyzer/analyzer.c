@@ -10,6 +10,7 @@
 #include "loadconfig.h"
 #include "error.h"
 #include "useful.h"
+#include "binlog.h"
 
 #define RPM_GRIDSIZE ( GRID_RPM_RANGE / GRID_RPM_INTERVAL )
 #define MAP_GRIDSIZE ( GRID_MAP_RANGE / GRID_MAP_INTERVAL )
@@ -148,7 +149,11 @@ int main(int argc, char **argv) {
   char *log;
   for(x=1;x<argc;x++) {
     printf("Loading file %s\n",argv[x]);
-    log = rf_loadfile(argv[x]);
+    if(binlog_detect(argv[x]) == 1) {
+      log = binlog_loadcsv(argv[x]); /* binary logs are converted first */
+    } else {
+      log = rf_loadfile(argv[x]);
+    }
     if(log == NULL) {
       printf("Couldn't load file, skipping.\n");
     } else {
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "binlog.h"
+
+/* read a null terminated string of len bytes, or return null if len is 0 */
+char *binlog_read_string(FILE *f, int len);
+
+binlog_t *binlog_open(char *filename) {
+  binlog_t *b = malloc(sizeof(binlog_t));
+  int x;
+  b->record = NULL;
+  b->bitmap = NULL;
+  b->f = fopen(filename,"r");
+  if(b->f == NULL) {
+    fprintf(stderr,"Couldn't open %s\n",filename);
+    free(b);
+    return NULL;
+  }
+
+  if(fread(&b->h,sizeof(binlog_header_t),1,b->f) != 1 ||
+     memcmp(b->h.magic,BINLOG_MAGIC,sizeof(b->h.magic)) != 0) {
+    fprintf(stderr,"%s is not a binary log\n",filename);
+    fclose(b->f);
+    free(b);
+    return NULL;
+  }
+  if(b->h.byteorder != BINLOG_BYTEORDER) {
+    fprintf(stderr,"%s was written on a host with a different byte order\n",
+            filename);
+    fclose(b->f);
+    free(b);
+    return NULL;
+  }
+  if(b->h.version < 1 || b->h.version > BINLOG_VERSION) {
+    fprintf(stderr,"%s is binary log version %i, expected up to %i\n",
+            filename,b->h.version,BINLOG_VERSION);
+    fclose(b->f);
+    free(b);
+    return NULL;
+  }
+
+  b->chan = malloc(sizeof(binlog_chan_t) * b->h.n_channels);
+  for(x=0;x<b->h.n_channels;x++) {
+    if(fread(&b->chan[x].d,sizeof(binlog_channel_t),1,b->f) != 1) break;
+    b->chan[x].name = binlog_read_string(b->f,b->chan[x].d.name_len);
+    b->chan[x].uom = binlog_read_string(b->f,b->chan[x].d.uom_len);
+    if(b->chan[x].name == NULL ||
+       (b->chan[x].uom == NULL && b->chan[x].d.uom_len > 0)) {
+      free(b->chan[x].name);
+      free(b->chan[x].uom);
+      break;
+    }
+  }
+  if(x != b->h.n_channels) {
+    fprintf(stderr,"%s has a truncated header\n",filename);
+    b->h.n_channels = x;
+    binlog_close(b);
+    return NULL;
+  }
+
+  /* the channels must add up to a full record */
+  size_t size = BINLOG_TIMESTAMP_SIZE;
+  for(x=0;x<b->h.n_channels;x++) size += b->chan[x].d.width;
+  if(size != b->h.record_size) {
+    fprintf(stderr,"%s has an inconsistent record size\n",filename);
+    binlog_close(b);
+    return NULL;
+  }
+
+  if(b->h.version == 1) b->h.flags = 0; /* was reserved */
+  b->record = malloc(b->h.record_size);
+  b->bitmap = malloc((b->h.n_channels + 7) / 8);
+  b->keyframed = 0;
+  b->t = 0;
+  return b;
+}
+
+char *binlog_read_string(FILE *f, int len) {
+  if(len == 0) return NULL;
+  char *out = malloc(len);
+  if(fread(out,len,1,f) != 1) {
+    free(out);
+    return NULL;
+  }
+  out[len - 1] = 0; /* don't trust the terminator */
+  return out;
+}
+
+int binlog_detect(char *filename) {
+  char magic[sizeof(BINLOG_MAGIC)];
+  FILE *f = fopen(filename,"r");
+  if(f == NULL) return 0;
+  int found = (fread(magic,sizeof(magic),1,f) == 1 &&
+               memcmp(magic,BINLOG_MAGIC,sizeof(magic)) == 0);
+  fclose(f);
+  return found;
+}
+
+int binlog_read(binlog_t *b) {
+  int type;
+  int x;
+  char *cursor;
+
+  if((b->h.flags & BINLOG_FLAG_DELTA) == 0) {
+    if(fread(b->record,b->h.record_size,1,b->f) != 1) return 0;
+    memcpy(&b->t,b->record,BINLOG_TIMESTAMP_SIZE);
+    /* timestamps never start at 0, so this is the zero padding of a
+       preallocated log that was never trimmed */
+    if(b->t == 0) return 0;
+    return 1;
+  }
+
+  type = fgetc(b->f);
+  if(type == BINLOG_KEYFRAME) {
+    if(fread(b->record,b->h.record_size,1,b->f) != 1) return 0;
+    b->keyframed = 1;
+  } else if(type == BINLOG_DELTA && b->keyframed == 1) {
+    if(fread(b->record,BINLOG_TIMESTAMP_SIZE,1,b->f) != 1) return 0;
+    if(fread(b->bitmap,(b->h.n_channels + 7) / 8,1,b->f) != 1) return 0;
+    cursor = b->record + BINLOG_TIMESTAMP_SIZE;
+    for(x=0;x<b->h.n_channels;x++) {
+      if(b->bitmap[x >> 3] & (1 << (x & 7))) {
+        if(fread(cursor,b->chan[x].d.width,1,b->f) != 1) return 0;
+      }
+      cursor += b->chan[x].d.width;
+    }
+  } else {
+    return 0; /* end of file, or garbage */
+  }
+  memcpy(&b->t,b->record,BINLOG_TIMESTAMP_SIZE);
+  return 1;
+}
+
+void binlog_seek(binlog_t *b, int64_t offset) {
+  fseeko(b->f,offset,SEEK_SET);
+  b->keyframed = 0; /* the previous record is no longer the base for deltas */
+}
+
+void binlog_csv_header(binlog_t *b, FILE *out) {
+  int x;
+  fprintf(out,"TIMESTAMP(ms)");
+  for(x=0;x<b->h.n_channels;x++) {
+    fprintf(out,",%s",b->chan[x].name);
+    if(b->chan[x].uom != NULL) fprintf(out,"(%s)",b->chan[x].uom);
+  }
+  fprintf(out,"\n");
+}
+
+void binlog_csv_record(binlog_t *b, FILE *out) {
+  char *cursor = b->record + BINLOG_TIMESTAMP_SIZE;
+  int32_t i;
+  float f;
+  int x;
+  fprintf(out,"%lu",(unsigned long)b->t);
+  for(x=0;x<b->h.n_channels;x++) {
+    switch(b->chan[x].d.type) {
+      case BINLOG_FLOAT:
+        memcpy(&f,cursor,4);
+        fprintf(out,",%.2f",f);
+        break;
+      case BINLOG_INT:
+        memcpy(&i,cursor,4);
+        fprintf(out,",%i",i);
+        break;
+      case BINLOG_BOOL:
+        fprintf(out,",%i",*cursor);
+        break;
+      default:
+        fprintf(out,",");
+    }
+    cursor += b->chan[x].d.width;
+  }
+  fprintf(out,"\n");
+}
+
+char *binlog_loadcsv(char *filename) {
+  char *buf = NULL;
+  size_t size = 0;
+  binlog_t *b = binlog_open(filename);
+  if(b == NULL) return NULL;
+  FILE *out = open_memstream(&buf,&size);
+  if(out == NULL) {
+    binlog_close(b);
+    return NULL;
+  }
+  binlog_csv_header(b,out);
+  while(binlog_read(b) == 1) binlog_csv_record(b,out);
+  fclose(out);
+  binlog_close(b);
+  return buf;
+}
+
+void binlog_close(binlog_t *b) {
+  int x;
+  for(x=0;x<b->h.n_channels;x++) {
+    free(b->chan[x].name);
+    free(b->chan[x].uom);
+  }
+  free(b->chan);
+  free(b->record);
+  free(b->bitmap);
+  fclose(b->f);
+  free(b);
+}
@@ -0,0 +1,62 @@
+#ifndef _BINLOG_H
+#define _BINLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../logformat.h"
+
+/************ SCOPE *********************************
+  Reader for binary logs written by the datalogger
+  with FORMAT=BINARY, including delta encoded logs,
+  and conversion of their records back into the
+  datalogger's csv layout.
+****************************************************/
+
+/* a channel descriptor with its strings */
+typedef struct _binlog_chan_t {
+  binlog_channel_t d;
+  char *name;
+  char *uom; /* null if the channel has no unit of measure */
+} binlog_chan_t;
+
+/* an open binary log */
+typedef struct _binlog_t {
+  FILE *f;
+  binlog_header_t h;
+  binlog_chan_t *chan;
+  uint32_t t;     /* timestamp of the last record read */
+  char *record;   /* the last record read as a full record, incl. timestamp.
+                     in a delta log, unchanged channels are carried over */
+  unsigned char *bitmap; /* change bitmap of a delta record */
+  int keyframed;  /* a keyframe has been read, so deltas can be applied */
+} binlog_t;
+
+/* check if a file is a binary log, without complaining if it isn't */
+int binlog_detect(char *filename);
+
+/* open a binary log and read its header.  returns null and prints an error if
+   the file can't be read or isn't a binary log of a known version. */
+binlog_t *binlog_open(char *filename);
+
+/* read the next record, expanding deltas.  returns 1 on success, 0 at the
+   end of the file.  a truncated or corrupt record counts as the end of the
+   file. */
+int binlog_read(binlog_t *b);
+
+/* continue reading at a byte offset from the start of the file, which must be
+   the start of a record, and a keyframe in a delta log. */
+void binlog_seek(binlog_t *b, int64_t offset);
+
+/* write the csv header line or the last record read, in the same layout as the
+   datalogger's csv format. */
+void binlog_csv_header(binlog_t *b, FILE *out);
+void binlog_csv_record(binlog_t *b, FILE *out);
+
+void binlog_close(binlog_t *b);
+
+/* load an entire binary log converted to csv text, like rf_loadfile does for
+   a csv log.  returns null if it can't be read. */
+char *binlog_loadcsv(char *filename);
+
+#endif
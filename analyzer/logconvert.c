@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "binlog.h"
+
+/************ SCOPE *********************************
+  Converts a binary log from the datalogger back to
+  the csv layout the datalogger would have written.
+****************************************************/
+
+int main(int argc, char **argv) {
+  binlog_t *b;
+  FILE *out = stdout;
+  unsigned long n_records = 0;
+
+  if(argc < 2 || argc > 3) {
+    fprintf(stderr,"usage: %s <log.bin> [out.csv]\n",argv[0]);
+    fprintf(stderr,"writes csv to stdout if no output file is given.\n");
+    return 1;
+  }
+
+  b = binlog_open(argv[1]);
+  if(b == NULL) return 1;
+
+  if(argc == 3) {
+    out = fopen(argv[2],"w");
+    if(out == NULL) {
+      fprintf(stderr,"Couldn't write to %s\n",argv[2]);
+      binlog_close(b);
+      return 1;
+    }
+  }
+
+  binlog_csv_header(b,out);
+  while(binlog_read(b) == 1) {
+    binlog_csv_record(b,out);
+    n_records++;
+  }
+
+  if(out != stdout) {
+    fclose(out);
+    fprintf(stderr,"Converted %lu records.\n",n_records);
+  }
+  binlog_close(b);
+  return 0;
+}
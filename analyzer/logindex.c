@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "logindex.h"
+
+/* index of the first of n entries with a timestamp after t, or n if none */
+unsigned int logindex_upper(logindex_entry_t *e, unsigned int n,
+                            unsigned long t);
+
+logindex_t *logindex_open(char *logname) {
+  logindex_header_t header;
+  logindex_entry_t *entry;
+  logindex_t *x;
+  unsigned int n_entries, n;
+  long size;
+  char *idxname = malloc(strlen(logname) + 5);
+  sprintf(idxname,"%s.idx",logname);
+  FILE *f = fopen(idxname,"r");
+  free(idxname);
+  if(f == NULL) return NULL;
+
+  if(fread(&header,sizeof(logindex_header_t),1,f) != 1 ||
+     memcmp(header.magic,LOGINDEX_MAGIC,sizeof(header.magic)) != 0 ||
+     header.byteorder != BINLOG_BYTEORDER ||
+     header.version != LOGINDEX_VERSION) {
+    fprintf(stderr,"%s.idx is not a usable log index\n",logname);
+    fclose(f);
+    return NULL;
+  }
+
+  /* the index is small, a few entries per second of log */
+  fseek(f,0,SEEK_END);
+  size = ftell(f) - sizeof(logindex_header_t);
+  fseek(f,sizeof(logindex_header_t),SEEK_SET);
+  n_entries = size / sizeof(logindex_entry_t); /* ignore a partial entry */
+  entry = malloc(sizeof(logindex_entry_t) * (n_entries + 1));
+  n_entries = fread(entry,sizeof(logindex_entry_t),n_entries,f);
+  fclose(f);
+
+  x = malloc(sizeof(logindex_t));
+  x->record = malloc(sizeof(logindex_entry_t) * (n_entries + 1));
+  x->state = malloc(sizeof(logindex_entry_t) * (n_entries + 1));
+  x->n_records = 0;
+  x->n_states = 0;
+  for(n=0;n<n_entries;n++) {
+    if(entry[n].type == LOGINDEX_RECORD) {
+      x->record[x->n_records++] = entry[n];
+    } else if(entry[n].type == LOGINDEX_STATE) {
+      x->state[x->n_states++] = entry[n];
+    }
+  }
+  free(entry);
+  return x;
+}
+
+unsigned int logindex_upper(logindex_entry_t *e, unsigned int n,
+                            unsigned long t) {
+  unsigned int low = 0;
+  unsigned int high = n;
+  unsigned int mid;
+  /* timestamps never decrease, so this is a plain binary search */
+  while(low < high) {
+    mid = low + (high - low) / 2;
+    if(e[mid].t <= t) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+int64_t logindex_seek(logindex_t *x, unsigned long t) {
+  unsigned int n = logindex_upper(x->record,x->n_records,t);
+  if(x->n_records == 0) return -1;
+  if(n == 0) return x->record[0].offset; /* t is before the first record */
+  return x->record[n - 1].offset;
+}
+
+int64_t logindex_seek_after(logindex_t *x, unsigned long t) {
+  unsigned int n = logindex_upper(x->record,x->n_records,t);
+  if(n == x->n_records) return -1;
+  return x->record[n].offset;
+}
+
+int logindex_state_at(logindex_t *x, unsigned long t) {
+  unsigned int n = logindex_upper(x->state,x->n_states,t);
+  if(n == 0) return -1;
+  return x->state[n - 1].state;
+}
+
+void logindex_close(logindex_t *x) {
+  free(x->record);
+  free(x->state);
+  free(x);
+}
@@ -0,0 +1,42 @@
+#ifndef _LOGINDEX_H
+#define _LOGINDEX_H
+
+#include <stdint.h>
+
+#include "../logformat.h"
+
+/************ SCOPE *********************************
+  Reader for the index sidecars the datalogger
+  writes with INDEX=1, for finding a point in a
+  log by time without reading the log itself.
+****************************************************/
+
+/* the entries are split by type so each can be binary searched */
+typedef struct _logindex_t {
+  logindex_entry_t *record; /* LOGINDEX_RECORD entries, in file order */
+  unsigned int n_records;
+  logindex_entry_t *state;  /* LOGINDEX_STATE entries, in file order */
+  unsigned int n_states;
+} logindex_t;
+
+/* load the index for a log, from the log's filename with .idx appended.
+   returns null if there is no usable index. */
+logindex_t *logindex_open(char *logname);
+
+/* the offset to start reading at to get every record from timestamp t on.
+   this is the last indexed record at or before t, or the first indexed
+   record if t is earlier than that.  returns -1 if there are no records. */
+int64_t logindex_seek(logindex_t *x, unsigned long t);
+
+/* the offset of the first indexed record after timestamp t, so that every
+   record up to t is before it.  returns -1 if the log has to be read to the
+   end. */
+int64_t logindex_seek_after(logindex_t *x, unsigned long t);
+
+/* the connection state at timestamp t, as of the last state change at or
+   before it.  returns -1 if no state change was indexed before t. */
+int logindex_state_at(logindex_t *x, unsigned long t);
+
+void logindex_close(logindex_t *x);
+
+#endif
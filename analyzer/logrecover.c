@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "../logformat.h"
+
+/************ SCOPE *********************************
+  Salvages every intact frame from a log written
+  with FRAME=1, such as one torn by a power cut,
+  and joins them back into a plain log.
+****************************************************/
+
+/* 1 if there is a frame with a good crc at buf, that fits in len bytes */
+int frame_intact(char *buf, size_t len, logframe_header_t *h);
+
+int main(int argc, char **argv) {
+  FILE *in, *out;
+  char *buf, *outname;
+  size_t size, pos, namelen;
+  long fsize;
+  logframe_header_t h;
+  uint32_t expect = 0;
+  unsigned long frames = 0, lost = 0, skipped = 0, bytes = 0;
+
+  if(argc < 2 || argc > 3) {
+    fprintf(stderr,"usage: %s <log.blk> [out]\n",argv[0]);
+    fprintf(stderr,"writes to the log name without .blk if no output file "
+                   "is given.\n");
+    return 1;
+  }
+
+  namelen = strlen(argv[1]);
+  if(argc == 3) {
+    outname = argv[2];
+  } else if(namelen > 4 && strcmp(argv[1] + namelen - 4,".blk") == 0) {
+    outname = malloc(namelen - 3);
+    memcpy(outname,argv[1],namelen - 4);
+    outname[namelen - 4] = 0;
+  } else {
+    fprintf(stderr,"%s doesn't end in .blk, give an output file.\n",argv[1]);
+    return 1;
+  }
+
+  /* a log is small enough to just load */
+  in = fopen(argv[1],"r");
+  if(in == NULL) {
+    fprintf(stderr,"Couldn't open %s\n",argv[1]);
+    return 1;
+  }
+  fseek(in,0,SEEK_END);
+  fsize = ftell(in);
+  fseek(in,0,SEEK_SET);
+  if(fsize <= 0) {
+    fprintf(stderr,"%s is empty.\n",argv[1]);
+    return 1;
+  }
+  size = fsize;
+  buf = malloc(size);
+  size = fread(buf,1,size,in);
+  fclose(in);
+
+  out = fopen(outname,"w");
+  if(out == NULL) {
+    fprintf(stderr,"Couldn't write to %s\n",outname);
+    return 1;
+  }
+
+  /* take every good frame in order, stepping a byte at a time through
+     anything else until the next one */
+  pos = 0;
+  while(pos + sizeof(logframe_header_t) <= size) {
+    if(frame_intact(buf + pos,size - pos,&h) == 0) {
+      pos++;
+      skipped++;
+      continue;
+    }
+    if(h.seq != expect) {
+      fprintf(stderr,"Frames %u to %u are missing.\n",expect,h.seq - 1);
+      if(h.seq > expect) lost += h.seq - expect;
+    }
+    fwrite(buf + pos + sizeof(logframe_header_t),h.length,1,out);
+    pos += sizeof(logframe_header_t) + h.length;
+    expect = h.seq + 1;
+    frames++;
+    bytes += h.length;
+  }
+  skipped += size - pos;
+  fclose(out);
+  free(buf);
+
+  fprintf(stderr,"Recovered %lu frames, %lu bytes to %s.  %lu frames lost, "
+                 "%lu bytes skipped.\n",frames,bytes,outname,lost,skipped);
+  return (frames == 0) ? 1 : 0;
+}
+
+int frame_intact(char *buf, size_t len, logframe_header_t *h) {
+  uLong crc;
+  if(memcmp(buf,LOGFRAME_MAGIC,sizeof(h->magic)) != 0) return 0;
+  memcpy(h,buf,sizeof(logframe_header_t));
+  /* a torn last frame runs off the end of the file */
+  if(h->length > len - sizeof(logframe_header_t)) return 0;
+  crc = crc32(0L,(Bytef *)&h->seq,sizeof(h->seq) + sizeof(h->length));
+  crc = crc32(crc,(Bytef *)buf + sizeof(logframe_header_t),h->length);
+  if(crc != h->crc) return 0;
+  return 1;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "binlog.h"
+#include "logindex.h"
+
+/************ SCOPE *********************************
+  Extracts the records between two timestamps from
+  a csv or binary log as csv, using the log's index
+  sidecar to skip straight to them.
+****************************************************/
+
+/* slice a csv log, returns the number of records written */
+unsigned long slice_csv(char *logname, int64_t start, int64_t end,
+                        unsigned long from, unsigned long to, FILE *out);
+
+/* slice a binary log, returns the number of records written */
+unsigned long slice_bin(char *logname, int64_t start, int64_t end,
+                        unsigned long from, unsigned long to, FILE *out);
+
+int main(int argc, char **argv) {
+  logindex_t *x;
+  FILE *out = stdout;
+  unsigned long from, to, n_records;
+  int64_t start, end;
+  int state;
+  size_t namelen;
+
+  if(argc < 4 || argc > 5) {
+    fprintf(stderr,"usage: %s <log> <from ms> <to ms> [out.csv]\n",argv[0]);
+    fprintf(stderr,"writes csv to stdout if no output file is given.\n");
+    return 1;
+  }
+
+  from = strtoul(argv[2],NULL,10);
+  to = strtoul(argv[3],NULL,10);
+
+  /* index offsets are into the plain, uncompressed data */
+  namelen = strlen(argv[1]);
+  if(namelen > 3 && strcmp(argv[1] + namelen - 3,".gz") == 0) {
+    fprintf(stderr,"%s is compressed, decompress it first.\n",argv[1]);
+    return 1;
+  }
+  if(namelen > 4 && strcmp(argv[1] + namelen - 4,".blk") == 0) {
+    fprintf(stderr,"%s is framed, unpack it with aldl-logrecover first.\n",
+            argv[1]);
+    return 1;
+  }
+
+  x = logindex_open(argv[1]);
+  if(x == NULL) {
+    fprintf(stderr,"No index for %s, was it logged with INDEX=1?\n",argv[1]);
+    return 1;
+  }
+  start = logindex_seek(x,from);
+  end = logindex_seek_after(x,to);
+  state = logindex_state_at(x,from);
+  logindex_close(x);
+  if(start < 0) {
+    fprintf(stderr,"%s has no indexed records.\n",argv[1]);
+    return 1;
+  }
+
+  if(argc == 5) {
+    out = fopen(argv[4],"w");
+    if(out == NULL) {
+      fprintf(stderr,"Couldn't write to %s\n",argv[4]);
+      return 1;
+    }
+  }
+
+  if(binlog_detect(argv[1]) == 1) {
+    n_records = slice_bin(argv[1],start,end,from,to,out);
+  } else {
+    n_records = slice_csv(argv[1],start,end,from,to,out);
+  }
+
+  if(out != stdout) fclose(out);
+  fprintf(stderr,"Sliced %lu records",n_records);
+  if(state >= 0) fprintf(stderr,", connection state %i at %lu",state,from);
+  fprintf(stderr,".\n");
+  return 0;
+}
+
+unsigned long slice_csv(char *logname, int64_t start, int64_t end,
+                        unsigned long from, unsigned long to, FILE *out) {
+  char *line = NULL;
+  size_t linesize = 0;
+  unsigned long t;
+  unsigned long n_records = 0;
+  FILE *f = fopen(logname,"r");
+  if(f == NULL) {
+    fprintf(stderr,"Couldn't open %s\n",logname);
+    return 0;
+  }
+
+  /* the header line is always at the start */
+  if(getline(&line,&linesize,f) > 0) fputs(line,out);
+
+  fseeko(f,start,SEEK_SET);
+  while(end < 0 || ftello(f) < end) {
+    if(getline(&line,&linesize,f) <= 0) break;
+    t = strtoul(line,NULL,10);
+    if(t == 0) break; /* zero padding of an untrimmed preallocated log */
+    if(t < from) continue;
+    if(t > to) break;
+    fputs(line,out);
+    n_records++;
+  }
+
+  free(line);
+  fclose(f);
+  return n_records;
+}
+
+unsigned long slice_bin(char *logname, int64_t start, int64_t end,
+                        unsigned long from, unsigned long to, FILE *out) {
+  unsigned long n_records = 0;
+  binlog_t *b = binlog_open(logname);
+  if(b == NULL) return 0;
+
+  binlog_csv_header(b,out);
+  binlog_seek(b,start);
+  while(end < 0 || ftello(b->f) < end) {
+    if(binlog_read(b) == 0) break;
+    if(b->t < from) continue;
+    if(b->t > to) break;
+    binlog_csv_record(b,out);
+    n_records++;
+  }
+
+  binlog_close(b);
+  return n_records;
+}
@@ -31,6 +31,10 @@
 /* debug structural functions, such as record link list management */
 #undef DEBUGSTRUCT
 
+/* decode every record with both the compiled decode plan and the original
+   per-definition parser, and bail if they aren't bit-for-bit identical */
+#undef DECODEPLAN_VERIFY
+
 /* print debugging info for memory */
 #undef DEBUGMEM
 
@@ -57,6 +61,7 @@
   #define RETARDED
   #define VERBLOSITY
   #define DEBUGSTRUCT
+  #define DECODEPLAN_VERIFY
 #endif
 
 /* --------- GLOBAL FEATURE CONFIG -----------------*/
@@ -67,15 +72,31 @@
    memory for cpu time. */
 #define ALDL_COMMBUFFER 2048
 
+/* size of the rx ring that the serial reader thread fills, in bytes.  this
+   only needs to hold what arrives between two reads by the acq thread, and
+   costs a timestamp per byte on top. */
+#define ALDL_RXBUFFER 4096
+
+/* milliseconds the serial reader thread waits for a byte before trying
+   again.  it wakes as soon as one arrives, so this only matters for idle
+   wakeups. */
+#define ALDL_RXWAIT 250
+
+/* after a request goes unanswered, the line has to be quiet this many
+   milliseconds before the next one is sent, so it isn't sent over the top of
+   a late reply.  waits no longer than ALDL_QUIETMAX ms. */
+#define ALDL_QUIETGAP 10
+#define ALDL_QUIETMAX 250
+
 /* --------- TIMING CONSTANTS ------------------------*/
 
-/* define for more aggressive timing behavior in an attempt to increase packet
-   rate, at a higher risk of dropped packets and increased cpu usage */
+/* define to skip the ACQRATE delay between acquisition iterations, in an
+   attempt to increase packet rate at the cost of cpu usage */
 #undef AGGRESSIVE
 
-/* a static delay in microseconds.  used for waiting in between grabbing
-   serial chunks, and other throttling.  if AGGRESSIVE is defined, this is
-   generally ignored ... */
+/* a static delay in microseconds, used as a floor for request timeouts.
+   serial reads don't need it, they sleep in the driver until data arrives
+   or their deadline passes. */
 #define SLEEPYTIME 200
 
 /* a theoretical maximum multiplier per byte that the ECM may take to generate
@@ -157,6 +178,29 @@
 #define FTDI_ATTEMPT_RECOVERY
 #define FTDI_MAXFAIL 3
 
+/* ------- TTY DRIVER CONFIG -------------------------*/
+
+/* the baud rate to set for the tty driver, set as a custom divisor since it
+   isn't a standard rate.  reccommend 8192. */
+#define TTY_BAUD 8192
+
+/* milliseconds serial_read waits for data to arrive before returning empty
+   handed, so callers polling it in a loop sleep instead of spinning. */
+#define TTY_POLL_TIMEOUT 1
+
+/* milliseconds to wait for room in the output buffer before a write fails */
+#define TTY_WRITE_TIMEOUT 100
+
+/* if the device node doesn't exist, try again every TTY_RETRY_DELAY seconds,
+   like FTDI_RETRY_USB. */
+#define TTY_RETRY_OPEN
+#define TTY_RETRY_DELAY 3
+
+/* if this many io operations fail, consider the interface failed and attempt
+   reconnection. */
+#define TTY_ATTEMPT_RECOVERY
+#define TTY_MAXFAIL 3
+
 /* ------- DUMMY DRIVER CONFIG ----------------------*/
 
 /* simulate random corruption in dummy packets */
@@ -168,6 +212,12 @@
 /* 0-100, strength of corruption */
 #define DUMMY_CORRUPTION_AMOUNT 3
 
+/* bytes the fake ecm can have in flight at once */
+#define DUMMY_QUEUE 1024
+
+/* milliseconds the fake ecm stays quiet after a shutup request */
+#define DUMMY_SHUTUP_TIME 2500
+
 /* ------- MISC CONSTANTS ---------------------------*/
 
 /* bad chars that can't be used in things such as unit of measure strings or
@@ -249,36 +249,31 @@ void cons_wait_for_connection() {
 void draw_bin(gauge_t *g) {
   aldl_define_t *def = &aldl->def[g->data_a];
   gauge_blank(g);
-  aldl_data_t *data = &rec->data[g->data_a];
-  if(data->i == 0) return;
+  if(record_get(aldl,rec,g->data_a).i == 0) return;
   attron(COLOR_PAIR(GREEN_ON_BLACK));
   mvprintw(g->y,g->x,"%s",def->name);
   attroff(COLOR_PAIR(GREEN_ON_BLACK));
 }
 
 void draw_errstr(gauge_t *g) {
-  int errfound = 0;
+  int errs[5]; /* display max 5 codes */
+  int errfound = record_errors(aldl,rec,errs,5);
   int x = 0;
   gauge_blank(g);
-  for(x=0;x<=aldl->n_defs - 1;x++) {
-    if(aldl->def[x].err == 1) { /* is an err flag */
-      if(rec->data[x].i == 1) { /* err flag is set */
-        if(errfound > 4) return; /* display max 4 codes */
-        attron(COLOR_PAIR(RED_ON_BLACK));
-        errfound++;
-        if(errfound == 1) mvprintw(g->y,g->x,"ERROR:");
-        printw(" %s",aldl->def[x].name);
-        attroff(COLOR_PAIR(RED_ON_BLACK));
-      }
-    }
+  if(errfound == 0) {
+    mvprintw(g->y,g->x,"NO ERRORS");
+    return;
   }
-  if(errfound == 0) mvprintw(g->y,g->x,"NO ERRORS");
+  attron(COLOR_PAIR(RED_ON_BLACK));
+  mvprintw(g->y,g->x,"ERROR:");
+  for(x=0;x<errfound;x++) printw(" %s",aldl->def[errs[x]].name);
+  attroff(COLOR_PAIR(RED_ON_BLACK));
 }
 
 void draw_simpletext_a(gauge_t *g) {
   aldl_define_t *def = &aldl->def[g->data_a];
   gauge_blank(g);
-  aldl_data_t *data = &rec->data[g->data_a];
+  aldl_data_t data = record_get(aldl,rec,g->data_a);
   if(alarm_range(g) == 1) attron(COLOR_PAIR(RED_ON_BLACK));
   switch(def->type) {
     case ALDL_FLOAT:
@@ -291,7 +286,7 @@ void draw_simpletext_a(gauge_t *g) {
     case ALDL_INT:
     case ALDL_BOOL:
       mvprintw(g->y,g->x,"%s: %i",
-          def->name,data->i);
+          def->name,data.i);
       #ifdef CONSOLEIF_UOM
       if(def->uom != NULL) printw(" %s",def->uom);
       #endif
@@ -304,16 +299,16 @@ void draw_simpletext_a(gauge_t *g) {
 
 int alarm_range(gauge_t *g) {
   aldl_define_t *def = &aldl->def[g->data_a];
-  aldl_data_t *data = &rec->data[g->data_a];
+  aldl_data_t data = record_get(aldl,rec,g->data_a);
   switch(def->type) {
     case ALDL_FLOAT:
-      if( ( def->alarm_low_enable == 1 && data->f < def->alarm_low.f ) ||
-      ( def->alarm_high_enable == 1 && data->f > def->alarm_high.f) ) return 1;
+      if( ( def->alarm_low_enable == 1 && data.f < def->alarm_low.f ) ||
+      ( def->alarm_high_enable == 1 && data.f > def->alarm_high.f) ) return 1;
       return 0;
       break;
     case ALDL_INT:
-      if( ( def->alarm_low_enable == 1 && data->i < def->alarm_low.i ) ||
-      ( def->alarm_high_enable == 1 && data->i > def->alarm_high.i) ) return 1;
+      if( ( def->alarm_low_enable == 1 && data.i < def->alarm_low.i ) ||
+      ( def->alarm_high_enable == 1 && data.i > def->alarm_high.i) ) return 1;
       return 0;
     default:
       return 0;
@@ -327,7 +322,7 @@ void draw_h_progressbar(gauge_t *g) {
   switch(def->type) {
     case ALDL_INT:
     case ALDL_BOOL:
-      data = rec->data[g->data_a].i;
+      data = record_get(aldl,rec,g->data_a).i;
       data_lm = rf_clamp_int(g->bottom,g->top,data);
       break;
     case ALDL_FLOAT:
@@ -464,22 +459,24 @@ char *gconfig(char *parameter, int n) {
 }
 
 float smooth_float(gauge_t *g) {
-  if(g->smoothing == 0) return (rec->data[g->data_a].f +
-                              rec->data[g->data_b].f) / 2;
+  if(g->smoothing == 0) return (record_get(aldl,rec,g->data_a).f +
+                              record_get(aldl,rec,g->data_b).f) / 2;
   int x;
   aldl_record_t *r = rec;
   float avg = 0;
   for(x=0;x<=g->smoothing;x++) {
-    avg += ( r->data[g->data_a].f + r->data[g->data_b].f ) / 2;
-    if(r->prev == NULL) { /* attempt to trap underrun (might not work) */
+    avg += ( record_get(aldl,r,g->data_a).f +
+             record_get(aldl,r,g->data_b).f ) / 2;
+    if(prev_record(r) == NULL) { /* trap underrun */
       error(1,ERROR_BUFFER,"buffer underrun caught in %s gauge\n\
            %i smoothing w/ %i total buffer, and %i prebuffer.\n\
             please decrease smoothing or increase prebuffer settings!!",
          aldl->def[g->data_a].name,g->smoothing,aldl->bufsize,aldl->bufstart);
     }
-    r = r->prev;
+    r = prev_record(r);
   }
-  avg += ( ( r->data[g->data_a].f + r->data[g->data_b].f ) / 2 ) * g->weight;
+  avg += ( ( record_get(aldl,r,g->data_a).f +
+             record_get(aldl,r,g->data_b).f ) / 2 ) * g->weight;
   return avg / ( g->smoothing + g->weight + 1 );
 }
 
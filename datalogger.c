@@ -4,173 +4,586 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
 
 /* local objects */
 #include "error.h"
 #include "aldl-io.h"
 #include "loadconfig.h"
 #include "useful.h"
+#include "logformat.h"
+#include "logwriter.h"
+#include "trigger.h"
+#include "modules.h"
 
-typedef struct _datalogger_conf {
-  dfile_t *dconf; /* raw config data */
-  int autostart;
+/* decimal places of float channels in csv logs */
+#define DATALOGGER_PRECISION 2
+
+/* output formats */
+typedef enum _datalogger_format {
+  LOGFORMAT_CSV = 0,
+  LOGFORMAT_BINARY = 1
+} datalogger_format_t;
+
+/* a sink is one stream of log files with its own channels, rate and format.
+   every sink is fed from the same pass over the record buffer. */
+typedef struct _datalogger_sink {
+  int n; /* sink number, -1 if configured by the top level options alone */
   char *log_filename;
   int log_all;
   int sync;
+  logwriter_conf_t wconf; /* log writer settings */
   int rate;
+  unsigned long last_timestamp; /* timestamp of the last record logged */
+  datalogger_format_t format;
+  int delta; /* write binary records as deltas against the previous one */
+  int keyframe_interval; /* records between full keyframes in delta mode */
+  char *channels; /* list of channel names to log, or NULL */
+  int n_channels; /* number of definitions being logged */
+  int *channel; /* definition index of each logged channel, in log order */
+  int *width; /* binary width of each logged channel */
+  size_t recsize; /* size of a full binary record */
+  char *fullrec; /* the record being encoded as a delta */
+  char *lastrec; /* the last record written, that deltas are against */
+  int since_keyframe; /* records since the last keyframe, 0 forces one */
+  char *linebuf; /* the header or record being written */
+  size_t linesize; /* length of data in linebuf */
+  unsigned long max_size; /* rotate after this many bytes, 0 to disable */
+  unsigned long max_time; /* rotate after this many ms, 0 to disable */
+  int rotate_on_reconnect; /* start a new file after a lost connection */
+  logwriter_t *writer;
+  unsigned long filesize; /* bytes logged to the current file */
+  unsigned long headersize; /* bytes of that which are the header */
+  unsigned long filestart; /* timestamp of the first record in the file */
+  int next_fd; /* the file to rotate to, opened ahead of time, or -1 */
+  char *next_filename;
+  int index; /* write an index sidecar for each log */
+  unsigned long index_interval; /* ms between index entries, 0 for none */
+  int index_records; /* records between index entries, 0 for none */
+  FILE *idx; /* index of the current log */
+  FILE *next_idx; /* index of the log opened ahead of time */
+  unsigned long idx_last; /* timestamp of the last record index entry */
+  int idx_count; /* records since the last record index entry, -1 if none */
+  int due; /* the record being handled is logged by this sink */
+  int index_due; /* and gets an index entry */
+  trigger_t *trigger; /* only log captures around this, or NULL */
+  unsigned long pre; /* ms of records before a trigger to capture */
+  unsigned long post; /* ms of records to capture after a trigger ends */
+  int capturing; /* a capture file is being written */
+  unsigned long capture_end; /* timestamp the current capture ends at */
+  aldl_record_t **prerec; /* records before a trigger, newest first */
+  unsigned long *preseq; /* and their sequence numbers */
+} datalogger_sink_t;
+
+typedef struct _datalogger_conf {
+  dfile_t *dconf; /* raw config data */
+  int autostart;
   int skip;
   int marker;
-  FILE *fdesc;
+  int n_sinks;
+  datalogger_sink_t *sink;
 } datalogger_conf_t;
 
 int logger_be_quiet(aldl_conf_t *aldl);
 
-void datalogger_make_file(datalogger_conf_t *conf,aldl_conf_t *aldl);
+/* create a new uniquely numbered log file and open it, and return the fd.
+   the name is stored in next_filename. */
+int datalogger_make_file(datalogger_sink_t *s,aldl_conf_t *aldl);
+
+/* 1 if the current file has reached a rotation limit at timestamp t, or is
+   within a quarter of one if soon is set. */
+int datalogger_rotate_due(datalogger_sink_t *s, unsigned long t, int soon);
+
+/* start the next file, opening it now if it wasn't prepared ahead of time,
+   and write its header.  the first record goes in at timestamp t. */
+void datalogger_rotate(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       unsigned long t);
+
+/* create the index sidecar for a log file, returns NULL on failure */
+FILE *datalogger_make_index(char *filename);
+
+/* 1 if the record at timestamp t should get a record index entry */
+int datalogger_index_due(datalogger_sink_t *s, unsigned long t);
+
+/* write an index entry for the current log */
+void datalogger_index(datalogger_sink_t *s, int type, unsigned long t,
+                      aldl_state_t state, unsigned long offset);
+
+/* write the header for the selected format */
+void datalogger_write_header(datalogger_sink_t *s, aldl_conf_t *aldl);
 
 datalogger_conf_t *datalogger_load_config(aldl_conf_t *aldl);
 
+/* load the options of sink n, or of the only sink if n is -1 */
+void datalogger_load_sink(datalogger_sink_t *s, aldl_conf_t *aldl,
+                          dfile_t *config, int n);
+
+/* the name of option parameter for sink n in buf.  a sink inherits any
+   option it doesn't set from the top level, so this is the bare parameter
+   if Sn.parameter isn't in the config. */
+char *sconfig(dfile_t *config, char *buf, char *parameter, int n);
+
+/* build the list of channels to be logged */
+void datalogger_select_channels(datalogger_sink_t *s, aldl_conf_t *aldl);
+
+/* size of the largest header or record produced by the selected format */
+size_t datalogger_bufsize(datalogger_sink_t *s, aldl_conf_t *aldl);
+
+/* format a record for a sink into its linebuf */
+void datalogger_format(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       aldl_record_t *rec);
+
+/* append the record formatted by datalogger_format to the log */
+void datalogger_commit(datalogger_sink_t *s, unsigned long t);
+
+/* check the trigger of a capture sink against a record, starting or ending
+   a capture as needed.  returns 1 if the record is part of a capture. */
+int datalogger_capture(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       aldl_record_t *rec);
+
+/* open a capture file and write the records from before the trigger at rec,
+   from the record buffer */
+void datalogger_capture_start(datalogger_sink_t *s, aldl_conf_t *aldl,
+                              aldl_record_t *rec);
+
+/* create the writer for a sink, and its first file */
+void datalogger_open(datalogger_sink_t *s, aldl_conf_t *aldl,
+                     unsigned long t);
+
+/* print writer statistics for a sink */
+void datalogger_writer_stats(datalogger_conf_t *conf, datalogger_sink_t *s);
+
+/* write a header or a single record into buf, returns the length */
+size_t datalogger_csv_header(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             char *buf);
+size_t datalogger_csv_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             aldl_record_t *rec, char *buf);
+size_t datalogger_bin_header(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             char *buf);
+size_t datalogger_bin_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             aldl_record_t *rec, char *buf);
+
+/* write a binary record in delta mode, as a keyframe or as a delta against
+   the last record.  datalogger_delta_commit must be called once the result
+   is actually written. */
+size_t datalogger_delta_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                               aldl_record_t *rec, char *buf);
+void datalogger_delta_commit(datalogger_sink_t *s);
+
 void *datalogger_init(void *aldl_in) {
   unsigned int n_records = 0; /* number of record counter */
-  unsigned long last_timestamp = 0;
-  int x = 0; /* tmp */
+  unsigned long seq; /* sequence number of the current record */
+  unsigned long lost = 0; /* records overwritten before they were logged */
+  unsigned long lost_reported = 0;
+  unsigned long lag = 0, maxlag = 0; /* records behind the acq thread */
   float pps; /* packet per second rate */
+  int due; /* number of sinks logging the current record */
+  int x;
+  datalogger_sink_t *s;
   aldl_conf_t *aldl = (aldl_conf_t *)aldl_in;
 
   /* grab config data */
   datalogger_conf_t *conf = datalogger_load_config(aldl);
 
-  /* calculate appropriate linebuffer size */
-  size_t linebufsize = 0;
-  for(x=0;x<aldl->n_defs;x++) {
-    if(aldl->def[x].log == 1 || conf->log_all == 1) {
-      if(aldl->def[x].type == ALDL_BOOL) {
-        linebufsize += 3; /* 3 bytes for a bool */
-      } else {
-        linebufsize += 64; /* 64 bytes for anything else */
-      }
-    }
+  /* calculate appropriate linebuffer sizes */
+  for(x=0;x<conf->n_sinks;x++) {
+    s = &conf->sink[x];
+    datalogger_select_channels(s,aldl);
+    size_t linebufsize = datalogger_bufsize(s,aldl);
+    s->linebuf = smalloc(linebufsize);
+    /* a block must fit at least the header or one record */
+    if(s->wconf.blocksize < linebufsize) s->wconf.blocksize = linebufsize;
   }
 
-  char *linebuf = smalloc(linebufsize);
-  char *cursor = linebuf; /* ptr to working byte in line buffer */
-
-  /* this label is to be used for pausing and starting a new logfile in case
-     one is required ... */
-  //JUMP_ROLL_LOG:
-
   /* wait for buffered connection.  we do this before creating the actual
      log file, this makes sense because if a connection never occurs,
      the file never gets made ... */
   pause_until_buffered(aldl);
 
-  /* create logfile */
-  datalogger_make_file(conf,aldl);
+  aldl_record_t *rec = newest_record(aldl);
+  seq = rec->seq;
 
-  cursor += sprintf(cursor,"TIMESTAMP(ms)"); /* string cursor */
-
-  /* write csv header */
-  for(x=0;x<aldl->n_defs;x++) {
-    if(conf->log_all == 0) {
-      if(aldl->def[x].log == 0) continue;
-    }
-    cursor += sprintf(cursor,",%s",aldl->def[x].name);
-    if(aldl->def[x].uom != NULL) {
-      cursor += sprintf(cursor,"(%s)",aldl->def[x].uom);
-    }
+  /* create logfiles, all writes go through the writer threads from here on.
+     capture sinks only get a file once they trigger. */
+  for(x=0;x<conf->n_sinks;x++) {
+    s = &conf->sink[x];
+    if(s->trigger == NULL) datalogger_open(s,aldl,rec->t);
   }
-  cursor += sprintf(cursor,"\n");
-  fwrite(linebuf,cursor - linebuf,1,conf->fdesc);
 
-  aldl_record_t *rec = aldl->r;
   /* event loop */
   while(1) {
     if(conf->skip == 1) {
       rec = newest_record_wait(aldl,rec);
+      if(rec != NULL) seq = rec->seq;
     } else {
-      rec = next_record_wait(aldl,rec);
+      rec = next_record_wait_seq(aldl,&seq,&lost);
     }
     if(rec == NULL) {
       if(logger_be_quiet(aldl) == 0) {
         printf("datalogger: Connection state: %s.  Waiting for connection...\n",
                 get_state_string(get_connstate(aldl)));
       }
+      for(x=0;x<conf->n_sinks;x++) {
+        s = &conf->sink[x];
+        if(s->trigger != NULL) {
+          trigger_reset(s->trigger);
+          s->capturing = 0; /* a capture never spans a lost connection */
+        }
+        if(s->writer == NULL) continue;
+        datalogger_index(s,LOGINDEX_STATE,s->last_timestamp,
+                         get_connstate(aldl),s->filesize);
+        logwriter_flush(s->writer); /* don't hold data while disconnected */
+        if(s->rotate_on_reconnect == 1 && s->trigger == NULL &&
+           s->next_fd < 0) {
+          s->next_fd = datalogger_make_file(s,aldl); /* while idle */
+        }
+      }
       pause_until_connected(aldl);
       if(logger_be_quiet(aldl) == 0) {
         printf("datalogger: Reconnected.  Resuming logging...\n");
       } 
+      for(x=0;x<conf->n_sinks;x++) {
+        s = &conf->sink[x];
+        if(s->writer == NULL) continue;
+        if(s->rotate_on_reconnect == 1 && s->trigger == NULL) {
+          datalogger_rotate(s,aldl,newest_record(aldl)->t);
+        }
+        datalogger_index(s,LOGINDEX_STATE,newest_record(aldl)->t,
+                         get_connstate(aldl),s->filesize);
+      }
       continue;
     }
-    if(last_timestamp + conf->rate >= rec->t) continue; /* skip record */
-    cursor=linebuf; /* reset cursor */
-    cursor += sprintf(cursor,"%lu",rec->t);
-    for(x=0;x<aldl->n_defs;x++) {
-      if(conf->log_all == 0) {
-        if(aldl->def[x].log == 0) continue;
-      }
-      switch(aldl->def[x].type) {
-        case ALDL_FLOAT:
-          cursor += sprintf(cursor,",%.2f",rec->data[x].f);
-          break;
-        case ALDL_INT:
-        case ALDL_BOOL:
-          cursor += sprintf(cursor,",%i",rec->data[x].i);
-          break;
-        default:
-          cursor += sprintf(cursor,",");
+
+    /* format the record for every sink that wants it */
+    due = 0;
+    for(x=0;x<conf->n_sinks;x++) {
+      s = &conf->sink[x];
+      s->due = 0;
+      if(s->trigger != NULL && datalogger_capture(s,aldl,rec) == 0) continue;
+      if(s->last_timestamp + s->rate >= rec->t) continue; /* skip record */
+      s->due = 1;
+      due++;
+      if(datalogger_rotate_due(s,rec->t,0) == 1) {
+        datalogger_rotate(s,aldl,rec->t);
+      } else if(s->next_fd < 0 && s->trigger == NULL &&
+                datalogger_rotate_due(s,rec->t,1) == 1) {
+        s->next_fd = datalogger_make_file(s,aldl);
       }
+      datalogger_format(s,aldl,rec);
     }
-    cursor += sprintf(cursor,"\n");
-    fwrite(linebuf,cursor - linebuf,1,conf->fdesc);
-    if(conf->sync == 1) fflush(conf->fdesc);
+    if(due == 0) continue;
+
+    /* the acq thread may have lapped us while formatting */
+    if(record_intact(rec,seq) == 0) {
+      lost++;
+      continue;
+    }
+
+    for(x=0;x<conf->n_sinks;x++) {
+      s = &conf->sink[x];
+      if(s->due == 1) datalogger_commit(s,rec->t);
+    }
+
+    lag = newest_record(aldl)->seq - seq;
+    if(lag > maxlag) maxlag = lag;
     if(logger_be_quiet(aldl) == 0) {
+      if(lost != lost_reported) {
+        printf("datalogger: Lapped by record buffer, %lu records lost.  "
+               "Max lag %lu of %i records.\n",
+               lost - lost_reported,maxlag,aldl->bufsize);
+        lost_reported = lost;
+      }
       n_records++;
       if(n_records % 300 == 0) {
         lock_stats();
         pps = aldl->stats->packetspersecond;
         unlock_stats();
-        printf("datalogger: Logged %u pkts @ %.2f/sec\n",n_records,pps);
+        printf("datalogger: Logged %u pkts @ %.2f/sec, lost %lu, max lag %lu\n",
+                n_records,pps,lost,maxlag);
+        for(x=0;x<conf->n_sinks;x++) {
+          if(conf->sink[x].writer == NULL) continue; /* never triggered */
+          datalogger_writer_stats(conf,&conf->sink[x]);
+        }
       }
     }
-    last_timestamp = rec->t; /* update timestamp */
   }
 
-  fclose(conf->fdesc);
+  for(x=0;x<conf->n_sinks;x++) {
+    s = &conf->sink[x];
+    if(s->writer != NULL) logwriter_close(s->writer);
+    if(s->next_fd >= 0) {
+      /* a file was prepared but never used */
+      close(s->next_fd);
+      unlink(s->next_filename);
+      if(s->next_idx != NULL) {
+        fclose(s->next_idx);
+        char *idxname = smalloc(strlen(s->next_filename) + 5);
+        sprintf(idxname,"%s.idx",s->next_filename);
+        unlink(idxname);
+        free(idxname);
+      }
+    }
+    if(s->idx != NULL) fclose(s->idx);
+    free(s->next_filename);
+    free(s->linebuf);
+    free(s->channel);
+    free(s->width);
+    if(s->delta == 1) {
+      free(s->fullrec);
+      free(s->lastrec);
+    }
+    if(s->trigger != NULL) {
+      trigger_free(s->trigger);
+      free(s->prerec);
+      free(s->preseq);
+    }
+  }
+  free(conf->sink);
   free(conf);
   /* end ... */
   return NULL;
 }
 
-void datalogger_make_file(datalogger_conf_t *conf,aldl_conf_t *aldl) {
+void datalogger_open(datalogger_sink_t *s, aldl_conf_t *aldl,
+                     unsigned long t) {
+  s->writer = logwriter_create(datalogger_make_file(s,aldl),&s->wconf);
+  if(logger_be_quiet(aldl) == 0) {
+    printf("datalogger: Logging data to file: %s\n",s->next_filename);
+  }
+  s->idx = s->next_idx;
+  s->next_idx = NULL;
+  datalogger_write_header(s,aldl);
+  s->filestart = t;
+}
+
+void datalogger_format(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       aldl_record_t *rec) {
+  s->index_due = datalogger_index_due(s,rec->t);
+  if(s->index_due == 1) s->since_keyframe = 0; /* seekable in delta mode */
+  if(s->delta == 1) {
+    s->linesize = datalogger_delta_record(s,aldl,rec,s->linebuf);
+  } else if(s->format == LOGFORMAT_BINARY) {
+    s->linesize = datalogger_bin_record(s,aldl,rec,s->linebuf);
+  } else {
+    s->linesize = datalogger_csv_record(s,aldl,rec,s->linebuf);
+  }
+}
+
+void datalogger_commit(datalogger_sink_t *s, unsigned long t) {
+  unsigned long offset = s->filesize; /* offset of the record in the log */
+  logwriter_append(s->writer,s->linebuf,s->linesize);
+  s->filesize += s->linesize;
+  if(s->delta == 1) datalogger_delta_commit(s);
+  if(s->index_due == 1) {
+    datalogger_index(s,LOGINDEX_RECORD,t,ALDL_CONNECTED,offset);
+  } else {
+    s->idx_count++;
+  }
+  s->last_timestamp = t; /* update timestamp */
+}
+
+int datalogger_capture(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       aldl_record_t *rec) {
+  if(trigger_check(s->trigger,aldl,rec) == 1) {
+    if(s->capturing == 0) datalogger_capture_start(s,aldl,rec);
+    s->capture_end = rec->t + s->post; /* extended while it stays true */
+  } else if(s->capturing == 1 && rec->t > s->capture_end) {
+    s->capturing = 0;
+    logwriter_flush(s->writer); /* get the whole event on disk now */
+    if(logger_be_quiet(aldl) == 0) {
+      printf("datalogger: Capture ended: %s\n",s->next_filename);
+    }
+  }
+  return s->capturing;
+}
+
+void datalogger_capture_start(datalogger_sink_t *s, aldl_conf_t *aldl,
+                              aldl_record_t *rec) {
+  aldl_record_t *r = rec;
+  int n = 0;
+  int x;
+
+  if(logger_be_quiet(aldl) == 0) {
+    printf("datalogger: Triggered at %lu ms\n",rec->t);
+  }
+  if(s->writer == NULL) {
+    datalogger_open(s,aldl,rec->t);
+  } else {
+    datalogger_rotate(s,aldl,rec->t);
+  }
+  s->capturing = 1;
+
+  /* walk back through the ring as far as PRE_TRIGGER, or as far as it goes */
+  while(n < aldl->bufsize && (r = prev_record(r)) != NULL) {
+    if(r->t + s->pre < rec->t) break;
+    s->prerec[n] = r;
+    s->preseq[n] = rec->seq - n - 1;
+    n++;
+  }
+
+  /* then write them oldest first, at the sink's rate */
+  s->last_timestamp = 0;
+  for(x=n-1;x>=0;x--) {
+    r = s->prerec[x];
+    if(s->last_timestamp + s->rate >= r->t) continue;
+    datalogger_format(s,aldl,r);
+    if(record_intact(r,s->preseq[x]) == 0) continue; /* lapped */
+    datalogger_commit(s,r->t);
+  }
+}
+
+void datalogger_writer_stats(datalogger_conf_t *conf, datalogger_sink_t *s) {
+  logwriter_stats_t wstats;
+  logwriter_get_stats(s->writer,&wstats);
+  if(conf->n_sinks > 1) printf("datalogger: Sink %i: ",s->n);
+  else printf("datalogger: ");
+  printf("Writer queue %u/%u (max %u, %lu stalls), "
+         "write %.2fms avg %.2fms max\n",
+         wstats.depth,s->wconf.n_blocks,wstats.maxdepth,wstats.stalls,
+         wstats.blocks == 0 ? 0.0 :
+           (float)wstats.lat_total / wstats.blocks / 1000000,
+         (float)wstats.lat_max / 1000000);
+  if(s->wconf.compress > 0 && wstats.bytes > 0) {
+    printf("datalogger: Compression %.1f:1, %.2fms cpu per block, "
+           "%.2fus cpu per kB\n",
+           (float)wstats.rawbytes / wstats.bytes,
+           (float)wstats.zcpu / wstats.blocks / 1000,
+           (float)wstats.zcpu / (wstats.rawbytes / 1024.0));
+  }
+}
+
+int datalogger_make_file(datalogger_sink_t *s,aldl_conf_t *aldl) {
   /* alloc and fill filename buffer */
-  int maxfnlength = strlen(conf->log_filename) * 2 + 50;
+  int maxfnlength = strlen(s->log_filename) * 2 + 50;
   struct tm *tm;
   time_t t;
   unsigned int suffix = 1;
   t = time(NULL);
   tm = localtime(&t);
   char *filename = smalloc(maxfnlength);
-  strftime(filename,maxfnlength,conf->log_filename,tm);
+  strftime(filename,maxfnlength,s->log_filename,tm);
   char *fnappend = filename;
   while(fnappend[0] != 0) fnappend++; /* find end of string */
   do {
-    sprintf(fnappend,"%05d.csv",suffix);
+    sprintf(fnappend,"%05d.%s%s%s",suffix,
+            s->format == LOGFORMAT_BINARY ? "bin" : "csv",
+            s->wconf.compress > 0 ? ".gz" : "",
+            s->wconf.frame == 1 ? ".blk" : "");
     suffix++;
   } while(access(filename,F_OK) == 0);
 
   /* open file */
-  conf->fdesc = fopen(filename, "a");
-  if(conf->fdesc == NULL) error(1,ERROR_PLUGIN,"cannot append to log");
+  int fd;
+  if(s->wconf.mmap == 1) {
+    fd = open(filename,O_RDWR | O_CREAT,0644); /* mapped files are read too */
+  } else {
+    fd = open(filename,O_WRONLY | O_CREAT |
+              (s->wconf.prealloc > 0 ? 0 : O_APPEND),0644);
+  }
+  if(fd < 0) error(1,ERROR_PLUGIN,"cannot append to log");
+
+  /* the index is made along with the log, so rotating never waits for it */
+  if(s->index == 1) s->next_idx = datalogger_make_index(filename);
 
-  /* print hello string if consoleif is disabled */
+  free(s->next_filename);
+  s->next_filename = filename;
+  return fd;
+}
+
+FILE *datalogger_make_index(char *filename) {
+  logindex_header_t header;
+  char *idxname = smalloc(strlen(filename) + 5);
+  sprintf(idxname,"%s.idx",filename);
+  FILE *idx = fopen(idxname,"w");
+  free(idxname);
+  if(idx == NULL) {
+    error(0,ERROR_PLUGIN,"cannot create log index for %s",filename);
+    return NULL;
+  }
+  memset(&header,0,sizeof(logindex_header_t));
+  strcpy(header.magic,LOGINDEX_MAGIC);
+  header.byteorder = BINLOG_BYTEORDER;
+  header.version = LOGINDEX_VERSION;
+  fwrite(&header,sizeof(logindex_header_t),1,idx);
+  return idx;
+}
+
+int datalogger_index_due(datalogger_sink_t *s, unsigned long t) {
+  if(s->idx == NULL) return 0;
+  if(s->idx_count < 0) return 1; /* the first record of the file */
+  if(s->index_interval > 0 && t - s->idx_last >= s->index_interval) {
+    return 1;
+  }
+  if(s->index_records > 0 && s->idx_count >= s->index_records) {
+    return 1;
+  }
+  return 0;
+}
+
+void datalogger_index(datalogger_sink_t *s, int type, unsigned long t,
+                      aldl_state_t state, unsigned long offset) {
+  logindex_entry_t entry;
+  if(s->idx == NULL) return;
+  entry.offset = offset;
+  entry.t = t;
+  entry.type = type;
+  entry.state = state;
+  fwrite(&entry,sizeof(logindex_entry_t),1,s->idx);
+  fflush(s->idx); /* an entry a second at most, keep it current */
+  if(type == LOGINDEX_RECORD) {
+    s->idx_last = t;
+    s->idx_count = 0;
+  }
+}
+
+int datalogger_rotate_due(datalogger_sink_t *s, unsigned long t, int soon) {
+  /* a file always gets at least one record, however small max_size is */
+  if(s->max_size > 0 && s->filesize > s->headersize) {
+    if(s->filesize >= s->max_size - (soon ? s->max_size / 4 : 0)) {
+      return 1;
+    }
+  }
+  if(s->max_time > 0) {
+    if(t - s->filestart >= s->max_time - (soon ? s->max_time / 4 : 0)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void datalogger_rotate(datalogger_sink_t *s, aldl_conf_t *aldl,
+                       unsigned long t) {
+  if(s->next_fd < 0) s->next_fd = datalogger_make_file(s,aldl);
+  logwriter_switch(s->writer,s->next_fd);
+  s->next_fd = -1;
+  if(s->idx != NULL) fclose(s->idx);
+  s->idx = s->next_idx;
+  s->next_idx = NULL;
+  s->filesize = 0;
+  s->filestart = t;
   if(logger_be_quiet(aldl) == 0) {
-    printf("datalogger: Logging data to file: %s\n",filename);
+    printf("datalogger: Logging data to file: %s\n",s->next_filename);
   }
+  datalogger_write_header(s,aldl);
+}
 
-  free(filename); /* shouldn't need to re-open it */
+void datalogger_write_header(datalogger_sink_t *s, aldl_conf_t *aldl) {
+  if(s->format == LOGFORMAT_BINARY) {
+    s->linesize = datalogger_bin_header(s,aldl,s->linebuf);
+  } else {
+    s->linesize = datalogger_csv_header(s,aldl,s->linebuf);
+  }
+  logwriter_append(s->writer,s->linebuf,s->linesize);
+  s->filesize += s->linesize;
+  s->headersize = s->linesize;
+  s->since_keyframe = 0; /* every file starts with a keyframe */
+  s->idx_count = -1; /* and an index entry */
 }
 
 datalogger_conf_t *datalogger_load_config(aldl_conf_t *aldl) {
   datalogger_conf_t *conf = smalloc(sizeof(datalogger_conf_t));
+  int x;
   if(aldl->datalogger_config == NULL) error(1,ERROR_CONFIG,
                                "no datalogger config file specified");
   conf->dconf = dfile_load(aldl->datalogger_config);
@@ -178,17 +591,364 @@ datalogger_conf_t *datalogger_load_config(aldl_conf_t *aldl) {
                                   "datalogger config file missing");
   dfile_t *config = conf->dconf;
   conf->autostart = configopt_int(config,"AUTOSTART",0,1,1);
-  conf->log_all = configopt_int(config,"LOG_ALL",0,1,0);
-  conf->log_filename = configopt_fatal(config,"LOG_FILENAME");
-  conf->sync = configopt_int(config,"SYNC",0,1,1);
   conf->skip = configopt_int(config,"SKIP",0,1,1);
   conf->marker = configopt_int(config,"MARKER",0,10000,100);
-  conf->rate = configopt_int(config,"RATE",1,10000,1);
+  /* without N_SINKS, the top level options describe the only sink */
+  conf->n_sinks = configopt_int(config,"N_SINKS",0,16,0);
+  if(conf->n_sinks == 0) {
+    conf->n_sinks = 1;
+    conf->sink = smalloc(sizeof(datalogger_sink_t));
+    datalogger_load_sink(&conf->sink[0],aldl,config,-1);
+  } else {
+    conf->sink = smalloc(sizeof(datalogger_sink_t) * conf->n_sinks);
+    for(x=0;x<conf->n_sinks;x++) {
+      datalogger_load_sink(&conf->sink[x],aldl,config,x);
+    }
+  }
   return conf;
 }
 
+char *sconfig(dfile_t *config, char *buf, char *parameter, int n) {
+  if(n < 0) return parameter;
+  sprintf(buf,"S%i.%s",n,parameter);
+  if(configopt(config,buf,NULL) == NULL) return parameter;
+  return buf;
+}
+
+void datalogger_load_sink(datalogger_sink_t *s, aldl_conf_t *aldl,
+                          dfile_t *config, int n) {
+  char c[64]; /* config parameter name buffer */
+  s->n = n;
+  s->log_all = configopt_int(config,sconfig(config,c,"LOG_ALL",n),0,1,0);
+  s->channels = configopt(config,sconfig(config,c,"CHANNELS",n),NULL);
+  s->log_filename = configopt_fatal(config,sconfig(config,c,"LOG_FILENAME",n));
+  s->sync = configopt_int(config,sconfig(config,c,"SYNC",n),0,1,1);
+  s->rate = configopt_int(config,sconfig(config,c,"RATE",n),1,10000,1);
+  s->last_timestamp = 0;
+  logwriter_conf_t *wconf = &s->wconf;
+  wconf->blocksize = configopt_int(config,sconfig(config,c,"BLOCK_SIZE",n),
+                                   512,1048576,65536);
+  wconf->n_blocks = configopt_int(config,sconfig(config,c,"BLOCKS",n),2,256,2);
+  wconf->compress = configopt_int(config,sconfig(config,c,"COMPRESS",n),0,9,0);
+  /* SYNC=1 hands every record to the writer thread as it arrives, unless
+     compressing, where single record blocks would barely compress */
+  wconf->flush_interval = configopt_int(config,
+                         sconfig(config,c,"FLUSH_INTERVAL",n),0,600000,
+                         (s->sync == 1 && wconf->compress == 0) ? 0 : 1000);
+  char *fsync_mode = configopt(config,sconfig(config,c,"FSYNC",n),"NONE");
+  if(rf_strcmp(fsync_mode,"NONE") == 1) {
+    wconf->syncmode = LOGWRITER_NOSYNC;
+  } else if(rf_strcmp(fsync_mode,"FSYNC") == 1) {
+    wconf->syncmode = LOGWRITER_FSYNC;
+  } else if(rf_strcmp(fsync_mode,"FDATASYNC") == 1) {
+    wconf->syncmode = LOGWRITER_FDATASYNC;
+  } else {
+    error(1,ERROR_CONFIG,"datalogger FSYNC must be NONE, FSYNC or FDATASYNC");
+  }
+  wconf->sync_interval = configopt_int(config,
+                         sconfig(config,c,"FSYNC_INTERVAL",n),0,600000,1000);
+  wconf->prealloc = (size_t)configopt_int(config,
+                    sconfig(config,c,"PREALLOCATE",n),0,1048576,0) * 1024;
+  wconf->align = configopt_int(config,sconfig(config,c,"ALIGN",n),
+                               512,1048576,4096);
+  if((wconf->align & (wconf->align - 1)) != 0) {
+    error(1,ERROR_CONFIG,"datalogger ALIGN must be a power of two");
+  }
+  wconf->mmap = configopt_int(config,sconfig(config,c,"MMAP",n),0,1,0);
+  wconf->msync_interval = configopt_int(config,
+                          sconfig(config,c,"MSYNC_INTERVAL",n),0,600000,1000);
+  wconf->frame = configopt_int(config,sconfig(config,c,"FRAME",n),0,1,0);
+  s->max_size = (unsigned long)configopt_int(config,
+                sconfig(config,c,"MAX_SIZE",n),0,2097152,0) * 1024;
+  s->max_time = (unsigned long)configopt_int(config,
+                sconfig(config,c,"MAX_TIME",n),0,604800,0) * 1000;
+  s->rotate_on_reconnect = configopt_int(config,
+                           sconfig(config,c,"ROTATE_ON_RECONNECT",n),0,1,0);
+  s->next_fd = -1;
+  s->next_filename = NULL;
+  s->index = configopt_int(config,sconfig(config,c,"INDEX",n),0,1,0);
+  s->index_interval = configopt_int(config,
+                      sconfig(config,c,"INDEX_INTERVAL",n),0,3600000,1000);
+  s->index_records = configopt_int(config,
+                     sconfig(config,c,"INDEX_RECORDS",n),0,1000000,0);
+  s->idx = NULL;
+  s->next_idx = NULL;
+  s->filesize = 0;
+  char *format = configopt(config,sconfig(config,c,"FORMAT",n),"CSV");
+  if(rf_strcmp(format,"CSV") == 1) {
+    s->format = LOGFORMAT_CSV;
+  } else if(rf_strcmp(format,"BINARY") == 1) {
+    s->format = LOGFORMAT_BINARY;
+  } else {
+    error(1,ERROR_CONFIG,"datalogger FORMAT must be CSV or BINARY");
+  }
+  s->delta = configopt_int(config,sconfig(config,c,"DELTA",n),0,1,0);
+  if(s->delta == 1 && s->format != LOGFORMAT_BINARY) {
+    error(1,ERROR_CONFIG,"datalogger DELTA requires FORMAT=BINARY");
+  }
+  s->keyframe_interval = configopt_int(config,
+                         sconfig(config,c,"KEYFRAME_INTERVAL",n),1,1000000,100);
+  s->writer = NULL;
+  s->capturing = 0;
+  char *trigger = configopt(config,sconfig(config,c,"TRIGGER",n),NULL);
+  if(trigger == NULL) {
+    s->trigger = NULL;
+  } else {
+    s->trigger = trigger_compile(aldl,trigger);
+    s->pre = configopt_int(config,sconfig(config,c,"PRE_TRIGGER",n),
+                           0,3600000,5000);
+    s->post = configopt_int(config,sconfig(config,c,"POST_TRIGGER",n),
+                            0,3600000,5000);
+    s->prerec = smalloc(sizeof(aldl_record_t *) * aldl->bufsize);
+    s->preseq = smalloc(sizeof(unsigned long) * aldl->bufsize);
+  }
+}
+
+void datalogger_select_channels(datalogger_sink_t *s, aldl_conf_t *aldl) {
+  int x;
+  char *list, *name, *end;
+  /* a sink with a CHANNELS list logs those instead of D*.LOG */
+  int *selected = smalloc(sizeof(int) * aldl->n_defs);
+  for(x=0;x<aldl->n_defs;x++) {
+    selected[x] = (s->channels == NULL) ? aldl->def[x].log : 0;
+  }
+  if(s->channels != NULL) {
+    list = smalloc(strlen(s->channels) + 1);
+    strcpy(list,s->channels);
+    name = list;
+    while(name != NULL) {
+      end = strchr(name,',');
+      if(end != NULL) *end = 0;
+      if(name[0] != 0) {
+        x = get_index_by_name(aldl,name);
+        if(x < 0) {
+          error(1,ERROR_CONFIG,"datalogger CHANNELS: no channel named %s",
+                name);
+        }
+        selected[x] = 1;
+      }
+      name = (end == NULL) ? NULL : end + 1;
+    }
+    free(list);
+  }
+  s->channel = smalloc(sizeof(int) * aldl->n_defs);
+  s->width = smalloc(sizeof(int) * aldl->n_defs);
+  s->n_channels = 0;
+  s->recsize = BINLOG_TIMESTAMP_SIZE;
+  /* channels are always logged in definition order */
+  for(x=0;x<aldl->n_defs;x++) {
+    if(selected[x] == 1 || s->log_all == 1) {
+      s->channel[s->n_channels] = x;
+      s->width[s->n_channels] = (aldl->def[x].type == ALDL_BOOL) ? 1 : 4;
+      s->recsize += s->width[s->n_channels];
+      s->n_channels++;
+    }
+  }
+  if(s->delta == 1) {
+    s->fullrec = smalloc(s->recsize);
+    s->lastrec = smalloc(s->recsize);
+    s->since_keyframe = 0;
+  }
+  free(selected);
+}
+
+size_t datalogger_bufsize(datalogger_sink_t *s, aldl_conf_t *aldl) {
+  size_t header = 0;
+  size_t record = 0;
+  aldl_define_t *def;
+  int x;
+  if(s->format == LOGFORMAT_BINARY) {
+    header = sizeof(binlog_header_t);
+    record = BINLOG_TIMESTAMP_SIZE;
+    if(s->delta == 1) record += 1 + (s->n_channels + 7) / 8;
+  } else {
+    header = 16; /* TIMESTAMP(ms) and newline */
+    record = 24; /* timestamp and newline */
+  }
+  for(x=0;x<s->n_channels;x++) {
+    def = &aldl->def[s->channel[x]];
+    if(s->format == LOGFORMAT_BINARY) {
+      header += sizeof(binlog_channel_t) + strlen(def->name) + 1;
+      if(def->uom != NULL) header += strlen(def->uom) + 1;
+      record += (def->type == ALDL_BOOL) ? 1 : 4;
+    } else {
+      header += strlen(def->name) + 4; /* comma, brackets, terminator */
+      if(def->uom != NULL) header += strlen(def->uom);
+      record += (def->type == ALDL_BOOL) ? 3 : 64;
+    }
+  }
+  return (header > record) ? header : record;
+}
+
+size_t datalogger_csv_header(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             char *buf) {
+  char *cursor = buf;
+  aldl_define_t *def;
+  int x;
+  cursor += sprintf(cursor,"TIMESTAMP(ms)");
+  for(x=0;x<s->n_channels;x++) {
+    def = &aldl->def[s->channel[x]];
+    cursor += sprintf(cursor,",%s",def->name);
+    if(def->uom != NULL) {
+      cursor += sprintf(cursor,"(%s)",def->uom);
+    }
+  }
+  cursor += sprintf(cursor,"\n");
+  return cursor - buf;
+}
+
+size_t datalogger_csv_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             aldl_record_t *rec, char *buf) {
+  return datalogger_csv_line(aldl,rec,s->channel,s->n_channels,buf);
+}
+
+size_t datalogger_csv_line(aldl_conf_t *aldl, aldl_record_t *rec,
+                           int *channel, int n_channels, char *buf) {
+  char *cursor = buf;
+  int x, idx;
+  /* formatted by hand, printf is most of the cost of a csv log */
+  cursor += rf_ultoa(cursor,rec->t);
+  for(x=0;x<n_channels;x++) {
+    idx = channel[x];
+    *cursor = ',';
+    cursor++;
+    switch(aldl->def[idx].type) {
+      case ALDL_FLOAT:
+        cursor += rf_ftoa(cursor,record_get(aldl,rec,idx).f,
+                          DATALOGGER_PRECISION);
+        break;
+      case ALDL_INT:
+      case ALDL_BOOL:
+        cursor += rf_itoa(cursor,record_get(aldl,rec,idx).i);
+        break;
+      default:
+        break;
+    }
+  }
+  *cursor = '\n';
+  cursor++;
+  return cursor - buf;
+}
+
+size_t datalogger_bin_header(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             char *buf) {
+  char *cursor = buf;
+  binlog_header_t header;
+  binlog_channel_t channel;
+  aldl_define_t *def;
+  size_t namelen, uomlen;
+  int x;
+
+  memset(&header,0,sizeof(binlog_header_t));
+  strcpy(header.magic,BINLOG_MAGIC);
+  header.byteorder = BINLOG_BYTEORDER;
+  header.version = BINLOG_VERSION;
+  header.n_channels = s->n_channels;
+  header.record_size = s->recsize;
+  if(s->delta == 1) header.flags |= BINLOG_FLAG_DELTA;
+  memcpy(cursor,&header,sizeof(binlog_header_t));
+  cursor += sizeof(binlog_header_t);
+
+  for(x=0;x<s->n_channels;x++) {
+    def = &aldl->def[s->channel[x]];
+    namelen = strlen(def->name) + 1;
+    uomlen = (def->uom == NULL) ? 0 : strlen(def->uom) + 1;
+    if(namelen > 255 || uomlen > 255) {
+      error(1,ERROR_CONFIG,"name or uom too long for binary log: %s",
+            def->name);
+    }
+    channel.type = def->type;
+    channel.width = s->width[x];
+    channel.precision = def->precision;
+    channel.packet = def->packet;
+    channel.offset = def->offset;
+    channel.size = def->size;
+    channel.name_len = namelen;
+    channel.uom_len = uomlen;
+    memcpy(cursor,&channel,sizeof(binlog_channel_t));
+    cursor += sizeof(binlog_channel_t);
+    memcpy(cursor,def->name,namelen);
+    cursor += namelen;
+    if(uomlen > 0) {
+      memcpy(cursor,def->uom,uomlen);
+      cursor += uomlen;
+    }
+  }
+  return cursor - buf;
+}
+
+size_t datalogger_bin_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                             aldl_record_t *rec, char *buf) {
+  char *cursor = buf;
+  uint32_t timestamp = rec->t;
+  int32_t i;
+  float f;
+  int x, idx;
+  memcpy(cursor,&timestamp,BINLOG_TIMESTAMP_SIZE);
+  cursor += BINLOG_TIMESTAMP_SIZE;
+  for(x=0;x<s->n_channels;x++) {
+    idx = s->channel[x];
+    switch(aldl->def[idx].type) {
+      case ALDL_FLOAT:
+        f = record_get(aldl,rec,idx).f;
+        memcpy(cursor,&f,4);
+        cursor += 4;
+        break;
+      case ALDL_BOOL:
+        *cursor = record_get(aldl,rec,idx).i;
+        cursor++;
+        break;
+      default:
+        i = record_get(aldl,rec,idx).i;
+        memcpy(cursor,&i,4);
+        cursor += 4;
+    }
+  }
+  return cursor - buf;
+}
+
+size_t datalogger_delta_record(datalogger_sink_t *s, aldl_conf_t *aldl,
+                               aldl_record_t *rec, char *buf) {
+  char *cursor = buf + 1;
+  char *bitmap;
+  size_t offset = BINLOG_TIMESTAMP_SIZE;
+  int x;
+
+  datalogger_bin_record(s,aldl,rec,s->fullrec);
+
+  if(s->since_keyframe == 0) {
+    buf[0] = BINLOG_KEYFRAME;
+    memcpy(cursor,s->fullrec,s->recsize);
+    return s->recsize + 1;
+  }
+
+  buf[0] = BINLOG_DELTA;
+  memcpy(cursor,s->fullrec,BINLOG_TIMESTAMP_SIZE);
+  cursor += BINLOG_TIMESTAMP_SIZE;
+  bitmap = cursor;
+  memset(bitmap,0,(s->n_channels + 7) / 8);
+  cursor += (s->n_channels + 7) / 8;
+  for(x=0;x<s->n_channels;x++) {
+    if(memcmp(s->fullrec + offset,s->lastrec + offset,
+              s->width[x]) != 0) {
+      bitmap[x >> 3] |= 1 << (x & 7);
+      memcpy(cursor,s->fullrec + offset,s->width[x]);
+      cursor += s->width[x];
+    }
+    offset += s->width[x];
+  }
+  return cursor - buf;
+}
+
+void datalogger_delta_commit(datalogger_sink_t *s) {
+  char *tmp = s->lastrec;
+  s->lastrec = s->fullrec;
+  s->fullrec = tmp;
+  s->since_keyframe++;
+  if(s->since_keyframe >= s->keyframe_interval) s->since_keyframe = 0;
+}
+
 int logger_be_quiet(aldl_conf_t *aldl) {
   if(aldl->consoleif_enable == 1) return 1;
   return 0;
 }
-
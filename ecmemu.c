@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+
+/************ SCOPE *********************************
+  A fake LT1 on the master side of a pseudo
+  terminal, for testing aldl-pi-tty without a car.
+  Replies trickle out at the real 8192 baud byte rate,
+  echoes every request like the ALDL line does, and
+  sends random but valid data packets.
+****************************************************/
+
+/* usage: aldl-ecmemu <link>
+
+   makes a pty and points a symlink at its slave side, set PORT to the link
+   in aldl-pi.conf and run aldl-pi-tty.  ctrl-c prints request counts. */
+
+/* microseconds per byte at 8192 baud, 8n1 */
+#define ECMEMU_BYTE_US 1220
+
+/* the LT1 datastream, see lt1.conf */
+#define ECMEMU_PCM_ADDRESS 0xF4
+#define ECMEMU_PACKET_LENGTH 64
+#define ECMEMU_MODE_SHUTUP 0x08
+#define ECMEMU_MODE_RETURN 0x00
+#define ECMEMU_MODE_DATA 0x01
+
+/* idle chatter is sent this often, in ms, unless told to shut up */
+#define ECMEMU_IDLE_INTERVAL 20
+
+typedef unsigned char byte;
+
+int ecmfd; /* master side of the pty */
+unsigned long n_requests, n_packets;
+
+/* send bytes one at a time, each after the time it takes on the wire */
+void ecm_send(byte *str, int len);
+
+/* the checksum byte that makes a message sum to zero */
+byte ecm_checksum(byte *str, int len);
+
+/* handle a complete request, which has already been echoed */
+void ecm_request(byte *str, int len, int *quiet);
+
+/* print counts and exit on a signal */
+void ecm_exit(int sig);
+
+int main(int argc, char **argv) {
+  struct termios t;
+  struct pollfd p;
+  byte in[256];
+  int n_in = 0;
+  int len, resp;
+  int quiet = 0; /* told to shut up, no idle chatter */
+  char *slave;
+  int slavefd;
+
+  if(argc != 2) {
+    fprintf(stderr,"usage: %s <link>\n",argv[0]);
+    fprintf(stderr,"makes a fake LT1 on a pty, linked at <link>.\n");
+    return 1;
+  }
+
+  ecmfd = posix_openpt(O_RDWR | O_NOCTTY);
+  if(ecmfd < 0 || grantpt(ecmfd) != 0 || unlockpt(ecmfd) != 0) {
+    fprintf(stderr,"Couldn't create a pty\n");
+    return 1;
+  }
+  slave = ptsname(ecmfd);
+
+  /* hold the slave open in raw mode, so the line discipline doesn't touch
+     anything before aldl-pi-tty opens it, and it stays up between runs */
+  slavefd = open(slave,O_RDWR | O_NOCTTY);
+  if(slavefd < 0 || tcgetattr(slavefd,&t) != 0) {
+    fprintf(stderr,"Couldn't open %s\n",slave);
+    return 1;
+  }
+  cfmakeraw(&t);
+  tcsetattr(slavefd,TCSANOW,&t);
+
+  unlink(argv[1]);
+  if(symlink(slave,argv[1]) != 0) {
+    fprintf(stderr,"Couldn't link %s to %s\n",argv[1],slave);
+    return 1;
+  }
+  printf("Fake LT1 on %s, linked at %s\n",slave,argv[1]);
+  fflush(stdout);
+
+  signal(SIGINT,ecm_exit);
+  signal(SIGTERM,ecm_exit);
+  srand(1);
+
+  p.fd = ecmfd;
+  p.events = POLLIN;
+  while(1) {
+    resp = poll(&p,1,quiet == 1 ? 200 : ECMEMU_IDLE_INTERVAL);
+    if(resp == 0) { /* nothing asked, chatter and drop any partial request */
+      if(quiet == 0) {
+        byte idle = 0x33;
+        ecm_send(&idle,1);
+      }
+      n_in = 0;
+      continue;
+    }
+    if(resp < 0) continue;
+    if(p.revents & POLLHUP) { /* nothing has the slave open */
+      usleep(10000);
+      continue;
+    }
+    resp = read(ecmfd,in + n_in,sizeof(in) - n_in);
+    if(resp <= 0) continue;
+    n_in += resp;
+
+    /* the second byte of a request is its length, plus 0x52 */
+    while(n_in >= 2) {
+      len = in[1] - 0x52;
+      if(len < 3 || len > 20) { /* not a request, resync a byte at a time */
+        memmove(in,in + 1,--n_in);
+        continue;
+      }
+      if(n_in < len) break;
+      ecm_send(in,len); /* the line echo */
+      ecm_request(in,len,&quiet);
+      memmove(in,in + len,n_in - len);
+      n_in -= len;
+    }
+  }
+  return 0;
+}
+
+void ecm_send(byte *str, int len) {
+  struct timespec t;
+  int x;
+  /* pace against the clock, so time spent in write doesn't add up */
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  for(x=0;x<len;x++) {
+    t.tv_nsec += ECMEMU_BYTE_US * 1000;
+    if(t.tv_nsec >= 1000000000) {
+      t.tv_sec++;
+      t.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&t,NULL);
+    if(write(ecmfd,str + x,1) != 1) perror("write");
+  }
+}
+
+byte ecm_checksum(byte *str, int len) {
+  int x;
+  int sum = 0;
+  for(x=0;x<len;x++) sum += str[x];
+  return 256 - ( sum & 0xFF );
+}
+
+void ecm_request(byte *str, int len, int *quiet) {
+  byte pkt[ECMEMU_PACKET_LENGTH];
+  int x;
+
+  switch(str[2]) {
+    case ECMEMU_MODE_SHUTUP:
+      *quiet = 1;
+      break;
+    case ECMEMU_MODE_RETURN:
+      *quiet = 0;
+      break;
+    case ECMEMU_MODE_DATA:
+      n_requests++;
+      pkt[0] = ECMEMU_PCM_ADDRESS;
+      pkt[1] = 0x52 + ECMEMU_PACKET_LENGTH;
+      pkt[2] = ECMEMU_MODE_DATA;
+      for(x=3;x<ECMEMU_PACKET_LENGTH - 1;x++) pkt[x] = rand();
+      pkt[ECMEMU_PACKET_LENGTH - 1] = ecm_checksum(pkt,
+                                                   ECMEMU_PACKET_LENGTH - 1);
+      ecm_send(pkt,ECMEMU_PACKET_LENGTH);
+      n_packets++;
+      break;
+  }
+}
+
+void ecm_exit(int sig) {
+  fprintf(stderr,"Fake LT1: %lu requests, %lu packets\n",n_requests,n_packets);
+  exit(0);
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "error.h"
+#include "aldl-io.h"
+#include "loadconfig.h"
+#include "useful.h"
+#include "modules.h"
+
+/************ SCOPE *********************************
+  Checks the number formatters in useful.c against
+  sprintf, and times csv log lines formatted with
+  them against the sprintf formatting the datalogger
+  used before, on the lt1.conf channel set.  Run by
+  make test, exits nonzero on any mismatch.
+****************************************************/
+
+/* float bit patterns are checked this far apart at the csv precision, and
+   this far apart at every other precision */
+#define FMTTEST_STRIDE 997
+#define FMTTEST_STRIDE_ALL 65521
+
+/* the csv log precision, see DATALOGGER_PRECISION */
+#define FMTTEST_PRECISION 2
+
+/* exact decimal ties checked per precision, of each sign */
+#define FMTTEST_TIES 1000
+
+/* int bit patterns are checked this far apart */
+#define FMTTEST_INT_STRIDE 65537
+
+/* records decoded from random packets, and lines timed, in the benchmark */
+#define FMTTEST_RECORDS 99
+#define FMTTEST_LINES 20000
+
+/* definition file with the benchmark channel set, relative to the source */
+#define FMTTEST_DEFFILE "config/lt1.conf"
+
+/* compare rf_ftoa with sprintf for one value, 1 if they differ */
+int check_ftoa(float f, int precision);
+
+/* compare rf_itoa and rf_ultoa with sprintf for one value, 1 if either
+   differs */
+int check_itoa(int i);
+int check_ultoa(unsigned long u);
+
+/* a csv log line as datalogger_csv_record wrote it with sprintf, before
+   rf_ftoa, for the benchmark */
+size_t csv_line_sprintf(aldl_conf_t *aldl, aldl_record_t *rec, int *channel,
+                        int n_channels, char *buf);
+
+/* fill every packet with random data and decode it into a new record */
+aldl_record_t *random_record(aldl_conf_t *aldl);
+
+double now_us();
+
+int main(int argc, char **argv) {
+  unsigned long long bits; /* a float bit pattern, walked past 32 bits */
+  unsigned int u;
+  float f;
+  int precision, m, sign;
+  int bad = 0;
+  int checked = 0;
+
+  /* every precision, a coarse stride of every bit pattern, which covers
+     zeroes, denormals, nan and inf along the way */
+  for(precision=0;precision<=9;precision++) {
+    for(bits=0;bits<=UINT_MAX;bits+=FMTTEST_STRIDE_ALL) {
+      u = bits;
+      memcpy(&f,&u,sizeof(float));
+      bad += check_ftoa(f,precision);
+      checked++;
+    }
+  }
+
+  /* the precision the datalogger uses, much closer together */
+  for(bits=0;bits<=UINT_MAX;bits+=FMTTEST_STRIDE) {
+    u = bits;
+    memcpy(&f,&u,sizeof(float));
+    bad += check_ftoa(f,FMTTEST_PRECISION);
+    checked++;
+  }
+
+  /* an odd multiple of 2^-(p+1) is exactly half way between two values
+     with p places, and has to round to even like printf does */
+  for(precision=0;precision<=9;precision++) {
+    for(m=0;m<FMTTEST_TIES;m++) {
+      for(sign=1;sign>=-1;sign-=2) {
+        f = sign * (float)(2 * m + 1) / (float)(2 << precision);
+        bad += check_ftoa(f,precision);
+        checked++;
+      }
+    }
+  }
+  printf("ftoa: %i values, %i mismatches\n",checked,bad);
+
+  int badint = 0;
+  checked = 0;
+  for(bits=0;bits<=UINT_MAX;bits+=FMTTEST_INT_STRIDE) {
+    badint += check_itoa((int)(unsigned int)bits);
+    checked++;
+  }
+  badint += check_itoa(0) + check_itoa(-1) + check_itoa(1);
+  badint += check_itoa(INT_MIN) + check_itoa(INT_MAX);
+  badint += check_ultoa(0) + check_ultoa(ULONG_MAX);
+  printf("itoa: %i values, %i mismatches\n",checked + 7,badint);
+
+  /* the benchmark, every channel of lt1.conf as with LOG_ALL */
+  init_locks();
+  aldl_conf_t *aldl = aldl_setup_deffile(argc > 1 ? argv[1] : FMTTEST_DEFFILE);
+  aldl_data_init(aldl);
+  int *channel = smalloc(sizeof(int) * aldl->n_defs);
+  int x;
+  for(x=0;x<aldl->n_defs;x++) channel[x] = x;
+
+  aldl_record_t *rec[FMTTEST_RECORDS];
+  srand(11);
+  for(x=0;x<FMTTEST_RECORDS;x++) rec[x] = random_record(aldl);
+
+  /* plenty for any line, the datalogger sizes this exactly */
+  char *line_a = smalloc(aldl->n_defs * 64 + 64);
+  char *line_b = smalloc(aldl->n_defs * 64 + 64);
+  size_t len_a, len_b;
+
+  /* both have to write exactly the same log */
+  int badline = 0;
+  for(x=0;x<FMTTEST_RECORDS;x++) {
+    len_a = csv_line_sprintf(aldl,rec[x],channel,aldl->n_defs,line_a);
+    len_b = datalogger_csv_line(aldl,rec[x],channel,aldl->n_defs,line_b);
+    if(len_a != len_b || memcmp(line_a,line_b,len_a) != 0) badline++;
+  }
+
+  size_t total = 0; /* so the loops can't be optimized out */
+  double start = now_us();
+  for(x=0;x<FMTTEST_LINES;x++) {
+    total += csv_line_sprintf(aldl,rec[x % FMTTEST_RECORDS],channel,
+                              aldl->n_defs,line_a);
+  }
+  double t_sprintf = now_us() - start;
+  start = now_us();
+  for(x=0;x<FMTTEST_LINES;x++) {
+    total += datalogger_csv_line(aldl,rec[x % FMTTEST_RECORDS],channel,
+                                 aldl->n_defs,line_b);
+  }
+  double t_ftoa = now_us() - start;
+  printf("bench: %i channel csv lines, %i mismatched, sprintf %.0f lines/sec, "
+         "rf_ftoa %.0f lines/sec (%lu bytes)\n",aldl->n_defs,badline,
+         FMTTEST_LINES / t_sprintf * 1000000,FMTTEST_LINES / t_ftoa * 1000000,
+         (unsigned long)total);
+
+  if(bad > 0 || badint > 0 || badline > 0) {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
+
+int check_ftoa(float f, int precision) {
+  char want[512];
+  char got[512];
+  int len_want = sprintf(want,"%.*f",precision,f);
+  int len_got = rf_ftoa(got,f,precision);
+  if(len_want != len_got || strcmp(want,got) != 0) {
+    printf("ftoa mismatch: %.9g at %i places, sprintf %s, rf_ftoa %s\n",
+           f,precision,want,got);
+    return 1;
+  }
+  return 0;
+}
+
+int check_itoa(int i) {
+  char want[32];
+  char got[32];
+  int len_want = sprintf(want,"%i",i);
+  int len_got = rf_itoa(got,i);
+  if(len_want != len_got || strcmp(want,got) != 0) {
+    printf("itoa mismatch: sprintf %s, rf_itoa %s\n",want,got);
+    return 1;
+  }
+  return 0;
+}
+
+int check_ultoa(unsigned long u) {
+  char want[32];
+  char got[32];
+  int len_want = sprintf(want,"%lu",u);
+  int len_got = rf_ultoa(got,u);
+  if(len_want != len_got || strcmp(want,got) != 0) {
+    printf("ultoa mismatch: sprintf %s, rf_ultoa %s\n",want,got);
+    return 1;
+  }
+  return 0;
+}
+
+size_t csv_line_sprintf(aldl_conf_t *aldl, aldl_record_t *rec, int *channel,
+                        int n_channels, char *buf) {
+  char *cursor = buf;
+  int x, idx;
+  cursor += sprintf(cursor,"%lu",rec->t);
+  for(x=0;x<n_channels;x++) {
+    idx = channel[x];
+    switch(aldl->def[idx].type) {
+      case ALDL_FLOAT:
+        cursor += sprintf(cursor,",%.2f",record_get(aldl,rec,idx).f);
+        break;
+      case ALDL_INT:
+      case ALDL_BOOL:
+        cursor += sprintf(cursor,",%i",record_get(aldl,rec,idx).i);
+        break;
+      default:
+        cursor += sprintf(cursor,",");
+    }
+  }
+  cursor += sprintf(cursor,"\n");
+  return cursor - buf;
+}
+
+aldl_record_t *random_record(aldl_conf_t *aldl) {
+  aldl_packetdef_t *pkt;
+  int x, y;
+  for(x=0;x<aldl->comm->n_packets;x++) {
+    pkt = &aldl->comm->packet[x];
+    for(y=0;y<pkt->length;y++) pkt->data[y] = rand();
+    pkt->dirty = 1;
+  }
+  return process_data(aldl);
+}
+
+double now_us() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+}
+
+void main_exit() {
+  exit(1);
+}
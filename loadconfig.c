@@ -41,17 +41,40 @@ void aldl_alloc_a(); /* fixed structures */
 void aldl_alloc_b(); /* definition arrays */
 void aldl_alloc_c(); /* more data space */
 
+/* everything after the root config file is loaded */
+aldl_conf_t *aldl_setup_config(dfile_t *config);
+
 /* config file loading */
 void load_config_a(dfile_t *config); /* load data to alloc_a structures */
 void load_config_b(dfile_t *config); /* load data to alloc_b structures */
 void load_config_c(dfile_t *config);
 char *load_config_root(dfile_t *config); /* returns path to sub config */
 
+/* build per-packet definition indexes, after stage c */
+void aldl_index_packets();
+
+/* precompute lookup tables for 8 bit definitions, after stage c */
+void aldl_build_tables();
+
+/* lay out definitions in record storage, packing booleans, after stage c */
+void aldl_pack_defs();
+
 aldl_conf_t *aldl_setup() {
   /* load root config file ... */
   dfile_t *config = dfile_load(ROOT_CONFIG_FILE);
   if(config == NULL) error(1,ERROR_CONFIG,
                         "cant load root config file: %s", ROOT_CONFIG_FILE);
+  return aldl_setup_config(config);
+}
+
+aldl_conf_t *aldl_setup_deffile(char *deffile) {
+  /* a root config that only names the definition file */
+  char *root = smalloc(strlen(deffile) + 13);
+  sprintf(root,"DEFINITION=%s\n",deffile);
+  return aldl_setup_config(dfile(root));
+}
+
+aldl_conf_t *aldl_setup_config(dfile_t *config) {
   #ifdef DEBUGCONFIG
   print_config(config);
   #endif
@@ -84,6 +107,10 @@ aldl_conf_t *aldl_setup() {
   #endif
   aldl_alloc_c();
   load_config_c(config);
+  aldl_index_packets();
+  aldl_pack_defs();
+  aldl_build_tables();
+  aldl_compile_plan(aldl);
   #ifdef DEBUGCONFIG
   printf("configuration complete.\n");
   #endif
@@ -126,6 +153,7 @@ char *load_config_root(dfile_t *config) {
   aldl->minmax = configopt_int(config,"MINMAX",0,1,1);
   aldl->maxfail = configopt_int(config,"MAXFAIL",1,1000,6);
   aldl->rate = configopt_int(config,"ACQRATE",0,100000,0);
+  aldl->pipeline = configopt_int(config,"PIPELINE",0,1,0);
   /* plugins */
   aldl->consoleif_enable = configopt_int(config,"CONSOLEIF_ENABLE",0,1,0);
   aldl->datalogger_enable = configopt_int(config,"DATALOGGER_ENABLE",0,1,0);
@@ -194,10 +222,16 @@ void aldl_alloc_c() {
     printf("packet %i raw storage: %i bytes\n",x,comm->packet[x].length);
     #endif
     if(comm->packet[x].data == NULL) error(1,ERROR_MEMORY,"pkt data");
+    if(aldl->pipeline == 1) {
+      comm->packet[x].rxdata = smalloc(comm->packet[x].length);
+    } else {
+      comm->packet[x].rxdata = comm->packet[x].data;
+    }
   }
 
   /* storage for data definitions */
   aldl->def = smalloc(sizeof(aldl_define_t) * aldl->n_defs);
+  memset(aldl->def,0,sizeof(aldl_define_t) * aldl->n_defs);
   #ifdef DEBUGMEM
   printf("aldl_define_t definition storage: %i bytes\n",
               (int)sizeof(aldl_define_t) * aldl->n_defs);
@@ -212,6 +246,8 @@ void load_config_c(dfile_t *config) {
   aldl_define_t *d;
   int z;
 
+  aldl->defindex = rf_hash_create(aldl->n_defs);
+
   for(x=0;x<aldl->n_defs;x++) {
     d = &aldl->def[x]; /* shortcut to def */
     tmp=configopt(config,dconfig(configstr,"TYPE",x),"FLOAT");
@@ -270,11 +306,9 @@ void load_config_c(dfile_t *config) {
     if(f != 0) {
       error(1,ERROR_CONFIG,"bad char %c in NAME of def %i",f,x);
     }
-    for(z=x-1;z>=0;z--) { /* check for duplicate name */
-      if(rf_strcmp(aldl->def[z].name,d->name) == 1) error(1,ERROR_CONFIG,
-                    "duplicate name %s at id %i and %i",
+    z = rf_hash_insert(aldl->defindex,d->name,x); /* index by name */
+    if(z != -1) error(1,ERROR_CONFIG,"duplicate name %s at id %i and %i",
                      d->name,x,z);
-    }
     d->description=configopt_fatal(config,dconfig(configstr,"DESC",x));
     d->log=configopt_int(config,dconfig(configstr,"LOG",x),0,1,0);
     d->display=configopt_int(config,dconfig(configstr,"DISPLAY",x),0,1,0);
@@ -285,6 +319,96 @@ void load_config_c(dfile_t *config) {
   free(configstr);
 }
 
+void aldl_index_packets() {
+  int x;
+  aldl_packetdef_t *p;
+  /* count definitions per packet */
+  for(x=0;x<comm->n_packets;x++) comm->packet[x].n_defs = 0;
+  for(x=0;x<aldl->n_defs;x++) comm->packet[aldl->def[x].packet].n_defs++;
+  /* allocate and fill index arrays */
+  for(x=0;x<comm->n_packets;x++) {
+    p = &comm->packet[x];
+    p->def = smalloc(sizeof(int) * ( p->n_defs + 1 ));
+    p->n_defs = 0; /* reused as a cursor, ends up the same */
+    p->dirty = 1; /* nothing has been decoded yet */
+  }
+  for(x=0;x<aldl->n_defs;x++) {
+    p = &comm->packet[aldl->def[x].packet];
+    p->def[p->n_defs] = x;
+    p->n_defs++;
+  }
+  #ifdef DEBUGCONFIG
+  for(x=0;x<comm->n_packets;x++) {
+    printf("packet %i sources %i definitions\n",x,comm->packet[x].n_defs);
+  }
+  #endif
+}
+
+void aldl_pack_defs() {
+  int x;
+  aldl_define_t *d;
+  aldl->n_data = 0;
+  aldl->n_bools = 0;
+  for(x=0;x<aldl->n_defs;x++) {
+    d = &aldl->def[x];
+    if(d->type == ALDL_BOOL) {
+      d->index = aldl->n_bools;
+      aldl->n_bools++;
+    } else {
+      d->index = aldl->n_data;
+      aldl->n_data++;
+    }
+  }
+  aldl->n_boolwords = ( aldl->n_bools + ALDL_WORDBITS - 1 ) / ALDL_WORDBITS;
+
+  /* reverse map and error code mask */
+  aldl->booldef = smalloc(sizeof(int) * ( aldl->n_bools + 1 ));
+  aldl->errmask = smalloc(sizeof(unsigned int) * ( aldl->n_boolwords + 1 ));
+  memset(aldl->errmask,0,sizeof(unsigned int) * ( aldl->n_boolwords + 1 ));
+  for(x=0;x<aldl->n_defs;x++) {
+    d = &aldl->def[x];
+    if(d->type != ALDL_BOOL) continue;
+    aldl->booldef[d->index] = x;
+    if(d->err == 1) {
+      aldl->errmask[d->index / ALDL_WORDBITS] |= 1u << (d->index % ALDL_WORDBITS);
+    }
+  }
+  #ifdef DEBUGMEM
+  printf("record storage: %i data, %i bools in %i words\n",
+         aldl->n_data,aldl->n_bools,aldl->n_boolwords);
+  #endif
+}
+
+void aldl_build_tables() {
+  int x;
+  unsigned int n; /* raw input value */
+  aldl_define_t *d;
+  for(x=0;x<aldl->n_defs;x++) {
+    d = &aldl->def[x];
+    d->table = NULL;
+    /* anything but 16 bit is decoded as 8 bit, see aldl_parse_def */
+    if(d->type == ALDL_BOOL || d->size == 16) continue;
+    d->table = smalloc(sizeof(aldl_data_t) * 256);
+    for(n=0;n<256;n++) {
+      /* this must stay identical to the conversion in aldl_parse_def */
+      if(d->type == ALDL_INT) {
+        d->table[n].i = ( (int)n * d->multiplier.i ) + d->adder.i;
+        if(aldl->minmax == 1) {
+          d->table[n].i = rf_clamp_int(d->min.i,d->max.i,d->table[n].i);
+        }
+      } else {
+        d->table[n].f = ( (float)n * d->multiplier.f ) + d->adder.f;
+        if(aldl->minmax == 1) {
+          d->table[n].f = rf_clamp_float(d->min.f,d->max.f,d->table[n].f);
+        }
+      }
+    }
+  }
+  #ifdef DEBUGMEM
+  printf("8 bit lookup tables: %i bytes each\n",(int)sizeof(aldl_data_t) * 256);
+  #endif
+}
+
 char *configopt_fatal(dfile_t *config, char *str) {
   char *val = configopt(config,str,NULL);
   if(val == NULL) error(1,ERROR_CONFIG_MISSING,str);
@@ -374,6 +498,7 @@ dfile_t *dfile_load(char *filename) {
   dfile_t *d = dfile(data);
   dfile_strip_quotes(d);
   dfile_shrink(d);
+  dfile_index(d);
   free(data);
   return d; 
 }
@@ -404,6 +529,7 @@ dfile_t *dfile(char *data) {
   out->p = smalloc(sizeof(char*) * MAX_PARAMETERS);
   out->v = smalloc(sizeof(char*) * MAX_PARAMETERS);
   out->n = 0;
+  out->index = NULL;
 
   /* more useful variables */
   char *c; /* operating cursor within data */
@@ -519,8 +645,19 @@ char *load_file(char *filename) {
   return buf;
 }
 
+void dfile_index(dfile_t *d) {
+  int x;
+  d->index = rf_hash_create(d->n);
+  for(x=0;x<d->n;x++) rf_hash_insert(d->index,d->p[x],x);
+}
+
 char *value_by_parameter(char *str, dfile_t *d) {
   int x;
+  if(d->index != NULL) {
+    x = rf_hash_get(d->index,str);
+    if(x == -1) return NULL;
+    return d->v[x];
+  }
   for(x=0;x<d->n;x++) {
     if(rf_strcmp(str,d->p[x]) == 1) return d->v[x];
   }
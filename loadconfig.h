@@ -2,6 +2,7 @@
 #define _LOADCONF_H
 
 #include "aldl-types.h"
+#include "useful.h"
 
 /************ SCOPE *********************************
   This object contains configuration file loading
@@ -19,11 +20,16 @@ typedef struct _dfile_t {
   unsigned int n; /* number of parameters */
   char **p;  /* parameter */
   char **v;  /* value */
+  rf_hash_t *index; /* parameter index, NULL until dfile_index is run */
 } dfile_t;
 
 /* configure all aldl structures and load config according to config file. */
 aldl_conf_t *aldl_setup();
 
+/* the same from a definition file alone, with every root config option left
+   at its default.  for test programs, which don't have a port. */
+aldl_conf_t *aldl_setup_deffile(char *deffile);
+
 /* loads file, strips quotes, shrinks, parses in one step.. */
 dfile_t *dfile_load(char *filename);
 
@@ -37,6 +43,10 @@ dfile_t *dfile(char *data);
    pointer to new data to be freed later. */
 char *dfile_shrink(dfile_t *d);
 
+/* build a hash index of parameters for value_by_parameter.  the first
+   occurrence of a duplicate parameter wins, as with a linear search. */
+void dfile_index(dfile_t *d);
+
 /* get a value by parameter string */
 char *value_by_parameter(char *str, dfile_t *d);
 
@@ -0,0 +1,116 @@
+#ifndef _LOGFORMAT_H
+#define _LOGFORMAT_H
+
+#include <stdint.h>
+
+/************ SCOPE *********************************
+  On-disk layout of the datalogger's binary log
+  format, index sidecar and block framing.
+  Shared between the datalogger and the offline
+  tools in analyzer/, so it must not depend on
+  anything else in the tree.
+****************************************************/
+
+/* a binary log is a header, followed by n_channels channel descriptors,
+   followed by records until the end of the file.  everything is in the byte
+   order of the host that wrote it; readers compare byteorder with
+   BINLOG_BYTEORDER to detect a mismatch. */
+
+#define BINLOG_MAGIC "ALDLBIN" /* 8 bytes incl. terminator */
+#define BINLOG_VERSION 2 /* version 1 had no flags, and is still readable */
+#define BINLOG_BYTEORDER 0x01020304
+
+/* header flags */
+#define BINLOG_FLAG_DELTA 0x01 /* records are delta encoded, see below */
+
+/* file header, 24 bytes, no padding */
+typedef struct _binlog_header_t {
+  char magic[8];         /* BINLOG_MAGIC */
+  uint32_t byteorder;    /* BINLOG_BYTEORDER as written by the logger */
+  uint16_t version;      /* BINLOG_VERSION */
+  uint16_t n_channels;   /* number of channel descriptors that follow */
+  uint32_t record_size;  /* size of a full record in bytes, incl. timestamp */
+  uint32_t flags;        /* BINLOG_FLAG_*, always 0 in version 1 */
+} binlog_header_t;
+
+/* channel types, these match aldl_datatype_t */
+#define BINLOG_INT 0   /* int32_t */
+#define BINLOG_FLOAT 1 /* 32 bit float */
+#define BINLOG_BOOL 2  /* uint8_t, 0 or 1 */
+
+/* channel descriptor, 8 bytes, followed by name_len bytes of name and then
+   uom_len bytes of unit of measure, both including a null terminator.  a
+   uom_len of 0 means no unit of measure. */
+typedef struct _binlog_channel_t {
+  uint8_t type;      /* BINLOG_INT, FLOAT or BOOL */
+  uint8_t width;     /* bytes used by this channel in each record */
+  uint8_t precision; /* display precision from the definition */
+  uint8_t packet;    /* source packet of the definition */
+  uint8_t offset;    /* source offset of the definition */
+  uint8_t size;      /* source size in bits */
+  uint8_t name_len;
+  uint8_t uom_len;
+} binlog_channel_t;
+
+/* a full record is a uint32_t timestamp in milliseconds, followed by each
+   channel in descriptor order, with no padding. */
+#define BINLOG_TIMESTAMP_SIZE 4
+
+/* with BINLOG_FLAG_DELTA, each record starts with a one byte type.  a
+   keyframe is followed by a full record.  a delta is followed by the
+   timestamp, a bitmap of (n_channels + 7) / 8 bytes with bit (x % 8) of byte
+   (x / 8) set for each channel x that changed since the previous record, and
+   then only the changed channels, in descriptor order.  the first record of
+   a file is always a keyframe. */
+#define BINLOG_KEYFRAME 'K'
+#define BINLOG_DELTA 'D'
+
+/* an index sidecar, named after its log with .idx appended, is a header
+   followed by entries in the order they were written, so timestamps never
+   decrease.  it works the same for every log format.  offsets are into the
+   log's uncompressed data, and always point at the start of a record, which
+   is a keyframe for delta logs. */
+
+#define LOGINDEX_MAGIC "ALDLIDX" /* 8 bytes incl. terminator */
+#define LOGINDEX_VERSION 1
+
+/* index file header, 16 bytes */
+typedef struct _logindex_header_t {
+  char magic[8];         /* LOGINDEX_MAGIC */
+  uint32_t byteorder;    /* BINLOG_BYTEORDER as written by the logger */
+  uint16_t version;      /* LOGINDEX_VERSION */
+  uint16_t reserved;
+} logindex_header_t;
+
+/* entry types */
+#define LOGINDEX_RECORD 0 /* a record starts at offset */
+#define LOGINDEX_STATE 1  /* the connection state changed to state at t, the
+                             next record will start at offset */
+
+/* index entry, 16 bytes */
+typedef struct _logindex_entry_t {
+  uint64_t offset;    /* byte offset in the log */
+  uint32_t t;         /* timestamp in milliseconds */
+  uint16_t type;      /* LOGINDEX_RECORD or LOGINDEX_STATE */
+  uint16_t state;     /* aldl_state_t for LOGINDEX_STATE entries */
+} logindex_entry_t;
+
+/* with FRAME=1, a log of any format, compressed or not, is written as a
+   sequence of frames, each a header followed by length bytes of the log.  a
+   frame is one block of the log writer and always holds whole records, so
+   every frame with a good crc can be salvaged from a torn file and the
+   frames joined back together to get the log itself.  seq counts frames
+   from 0 in each file, so lost frames show up as a gap.  the crc is the
+   zlib crc32 of seq and length, as they are stored, and then the data. */
+
+#define LOGFRAME_MAGIC "ALDF" /* 4 bytes, no terminator */
+
+/* frame header, 16 bytes */
+typedef struct _logframe_header_t {
+  char magic[4];     /* LOGFRAME_MAGIC */
+  uint32_t seq;      /* frame number in the file */
+  uint32_t length;   /* bytes of data that follow */
+  uint32_t crc;
+} logframe_header_t;
+
+#endif
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <linux/falloc.h>
+#include <zlib.h>
+
+/* local objects */
+#include "aldl-types.h"
+#include "error.h"
+#include "useful.h"
+#include "logformat.h"
+#include "logwriter.h"
+
+/************ SCOPE *********************************
+  Asynchronous block writer for log files.  See
+  logwriter.h.
+****************************************************/
+
+/* glibc only declares this with _GNU_SOURCE, which clashes with error_t */
+int fallocate(int fd, int mode, off_t offset, off_t len);
+
+/* segment size for mmap mode when none is given */
+#define LOGWRITER_MAPSIZE 1048576
+
+/* the file the writer thread is currently writing to */
+typedef struct _logwriter_file {
+  int fd;
+  off_t pos;        /* length of the data written so far */
+  off_t allocated;  /* length preallocated so far */
+  int noalloc;      /* preallocation failed, don't keep trying */
+  char *page;       /* staging buffer, starts with the last partial page */
+  unsigned long preallocs; /* preallocations not yet counted in stats */
+  char *map;        /* mapped segment in mmap mode, or NULL */
+  off_t mapstart;   /* file offset of the mapped segment */
+  off_t synced;     /* data before this offset has been synced */
+  uint32_t seq;     /* next frame number */
+} logwriter_file_t;
+
+/* the writer thread */
+void *logwriter_thread(void *w_in);
+
+/* start writing to a file.  page must hold the largest write plus two
+   alignment units when preallocating. */
+void logwriter_file_open(logwriter_t *w, logwriter_file_t *f, int fd);
+
+/* append to the file, aligned and preallocated if configured.  returns 0 on
+   failure. */
+int logwriter_file_write(logwriter_t *w, logwriter_file_t *f, char *buf,
+                         size_t len);
+
+/* copy into the mapped file in mmap mode, mapping the next segment as
+   needed.  returns 0 on failure. */
+int logwriter_file_map(logwriter_t *w, logwriter_file_t *f, char *buf,
+                       size_t len);
+
+/* trim the file to its real length.  in mmap mode, also unmap it and sync
+   it, so a switch or close is a durability point whatever the sync mode. */
+void logwriter_file_finish(logwriter_t *w, logwriter_file_t *f);
+
+/* hand the current block to the writer thread.  must be called without the
+   lock held. */
+void logwriter_handoff(logwriter_t *w);
+
+/* write a whole buffer, retrying short writes.  returns 0 on failure. */
+int logwriter_writeall(int fd, char *buf, size_t len);
+
+/* commit written data to storage according to the sync mode */
+void logwriter_sync(logwriter_t *w, logwriter_file_t *f);
+
+/* compress len bytes of in as one gzip member into out, which must hold
+   deflateBound() bytes.  returns the compressed size, or 0 on failure. */
+size_t logwriter_deflate(z_stream *z, char *in, size_t len, char *out,
+                         size_t outsize);
+
+/* put a frame header in front of len bytes of data at out, which must have
+   room for it.  returns the length of the whole frame. */
+size_t logwriter_frame(logwriter_file_t *f, char *out, size_t len);
+
+/* nanoseconds or microseconds between two monotonic timestamps.  64 bits,
+   as a long only holds about 2 seconds of nanoseconds on a 32 bit pi. */
+uint64_t logwriter_elapsed_ns(struct timespec *a, struct timespec *b);
+uint64_t logwriter_elapsed_us(struct timespec *a, struct timespec *b);
+
+logwriter_t *logwriter_create(int fd, logwriter_conf_t *c) {
+  logwriter_t *w = smalloc(sizeof(logwriter_t));
+  pthread_condattr_t cattr;
+  unsigned int x;
+  size_t pagesize;
+  memset(w,0,sizeof(logwriter_t));
+  w->fd = fd;
+  w->blocksize = c->blocksize;
+  w->n_blocks = (c->n_blocks < 2) ? 2 : c->n_blocks; /* double buffered */
+  w->block = smalloc(sizeof(char *) * w->n_blocks);
+  w->fill = smalloc(sizeof(size_t) * w->n_blocks);
+  w->blockfd = smalloc(sizeof(int) * w->n_blocks);
+  for(x=0;x<w->n_blocks;x++) {
+    w->block[x] = smalloc(w->blocksize);
+    w->fill[x] = 0;
+  }
+  w->flush_interval = c->flush_interval;
+  w->syncmode = c->syncmode;
+  w->sync_interval = c->sync_interval;
+  w->periodic = (w->syncmode != LOGWRITER_NOSYNC);
+  w->compress = c->compress;
+  w->prealloc = c->prealloc;
+  w->mmap = c->mmap;
+  w->frame = c->frame;
+  if(w->mmap == 1) {
+    /* segments must be whole pages */
+    pagesize = sysconf(_SC_PAGESIZE);
+    if(w->prealloc == 0) w->prealloc = LOGWRITER_MAPSIZE;
+    w->prealloc = (w->prealloc + pagesize - 1) / pagesize * pagesize;
+    if(c->msync_interval > 0) { /* every sync is an msync anyway */
+      w->sync_interval = c->msync_interval;
+      w->periodic = 1;
+    }
+  }
+  w->align = (c->prealloc > 0 && c->align > 0) ? c->align : 1;
+  clock_gettime(CLOCK_MONOTONIC,&w->lastflush);
+
+  pthread_mutex_init(&w->lock,NULL);
+  /* the writer thread uses timed waits on the monotonic clock */
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setclock(&cattr,CLOCK_MONOTONIC);
+  pthread_cond_init(&w->queued,&cattr);
+  pthread_condattr_destroy(&cattr);
+  pthread_cond_init(&w->freed,NULL);
+
+  if(pthread_create(&w->thread,NULL,logwriter_thread,(void *)w) != 0) {
+    error(1,ERROR_PLUGIN,"cannot start log writer thread");
+  }
+  return w;
+}
+
+void logwriter_append(logwriter_t *w, char *data, size_t len) {
+  unsigned int cur = w->filled % w->n_blocks;
+  struct timespec now;
+
+  if(len > w->blocksize) {
+    error(1,ERROR_BUFFER,"log write of %u bytes exceeds block size %u",
+          (unsigned int)len,(unsigned int)w->blocksize);
+  }
+
+  /* records never straddle blocks */
+  if(w->fill[cur] + len > w->blocksize) {
+    logwriter_handoff(w);
+    cur = w->filled % w->n_blocks;
+  }
+
+  memcpy(w->block[cur] + w->fill[cur],data,len);
+  w->fill[cur] += len;
+
+  if(w->fill[cur] == w->blocksize || w->flush_interval == 0) {
+    logwriter_handoff(w);
+  } else {
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    if(logwriter_elapsed_us(&w->lastflush,&now) / 1000 >= w->flush_interval) {
+      logwriter_handoff(w);
+    }
+  }
+}
+
+void logwriter_flush(logwriter_t *w) {
+  if(w->fill[w->filled % w->n_blocks] > 0) logwriter_handoff(w);
+}
+
+void logwriter_switch(logwriter_t *w, int fd) {
+  logwriter_flush(w);
+  w->fd = fd;
+}
+
+void logwriter_handoff(logwriter_t *w) {
+  unsigned int depth;
+  w->blockfd[w->filled % w->n_blocks] = w->fd;
+  pthread_mutex_lock(&w->lock);
+  w->filled++;
+  depth = w->filled - w->written;
+  w->stats.depth = depth;
+  if(depth > w->stats.maxdepth) w->stats.maxdepth = depth;
+  pthread_cond_signal(&w->queued);
+  /* wait until the next block in the ring has been written */
+  if(w->filled - w->written >= w->n_blocks) {
+    w->stats.stalls++;
+    while(w->filled - w->written >= w->n_blocks) {
+      pthread_cond_wait(&w->freed,&w->lock);
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+  w->fill[w->filled % w->n_blocks] = 0;
+  clock_gettime(CLOCK_MONOTONIC,&w->lastflush);
+}
+
+void logwriter_close(logwriter_t *w) {
+  unsigned int x;
+  logwriter_flush(w);
+  pthread_mutex_lock(&w->lock);
+  w->closing = 1;
+  pthread_cond_signal(&w->queued);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread,NULL);
+  close(w->fd);
+  for(x=0;x<w->n_blocks;x++) free(w->block[x]);
+  free(w->block);
+  free(w->fill);
+  free(w->blockfd);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->queued);
+  pthread_cond_destroy(&w->freed);
+  free(w);
+}
+
+void logwriter_get_stats(logwriter_t *w, logwriter_stats_t *out) {
+  pthread_mutex_lock(&w->lock);
+  memcpy(out,&w->stats,sizeof(logwriter_stats_t));
+  pthread_mutex_unlock(&w->lock);
+}
+
+void *logwriter_thread(void *w_in) {
+  logwriter_t *w = (logwriter_t *)w_in;
+  struct timespec start, end, lastsync, deadline, zstart, zend;
+  unsigned int cur;
+  uint64_t lat;
+  uint64_t zcpu = 0;
+  char *out; /* the data actually written for a block */
+  size_t outlen;
+  z_stream z;
+  char *zbuf = NULL; /* compressed output */
+  size_t zbufsize = 0;
+  char *fbuf = NULL; /* framed output */
+  size_t maxout; /* the most written for one block */
+  int unsynced = 0; /* written data that hasn't been synced yet */
+  int failed = 0; /* report write errors once */
+  logwriter_file_t f; /* file the writer thread is currently writing to */
+  unsigned long preallocs;
+
+  if(w->compress > 0) {
+    memset(&z,0,sizeof(z_stream));
+    /* window bits 15 + 16 selects a gzip wrapper */
+    if(deflateInit2(&z,w->compress,Z_DEFLATED,15 + 16,8,
+                    Z_DEFAULT_STRATEGY) != Z_OK) {
+      error(1,ERROR_PLUGIN,"cannot initialize log compression");
+    }
+    zbufsize = deflateBound(&z,w->blocksize);
+    zbuf = smalloc(zbufsize);
+  }
+
+  maxout = (zbufsize > w->blocksize) ? zbufsize : w->blocksize;
+  if(w->frame == 1) {
+    fbuf = smalloc(maxout + sizeof(logframe_header_t));
+    maxout += sizeof(logframe_header_t);
+  }
+
+  f.page = NULL;
+  f.map = NULL;
+  if(w->prealloc > 0 && w->mmap == 0) {
+    f.page = smalloc(maxout + w->align * 2);
+  }
+  logwriter_file_open(w,&f,w->fd);
+
+  clock_gettime(CLOCK_MONOTONIC,&lastsync);
+  pthread_mutex_lock(&w->lock);
+  while(1) {
+    if(w->written == w->filled) {
+      if(w->closing == 1) break;
+      if(unsynced == 1 && w->periodic == 1) {
+        /* sleep no later than the next sync is due */
+        deadline = lastsync;
+        deadline.tv_sec += w->sync_interval / 1000;
+        deadline.tv_nsec += (w->sync_interval % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000) {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000;
+        }
+        if(pthread_cond_timedwait(&w->queued,&w->lock,&deadline) != 0) {
+          pthread_mutex_unlock(&w->lock);
+          logwriter_sync(w,&f);
+          clock_gettime(CLOCK_MONOTONIC,&lastsync);
+          unsynced = 0;
+          pthread_mutex_lock(&w->lock);
+          w->stats.syncs++;
+        }
+      } else {
+        pthread_cond_wait(&w->queued,&w->lock);
+      }
+      continue;
+    }
+
+    /* write the oldest queued block without holding the lock */
+    cur = w->written % w->n_blocks;
+    pthread_mutex_unlock(&w->lock);
+
+    /* the file was switched, finish off the old one */
+    if(w->blockfd[cur] != f.fd) {
+      logwriter_file_finish(w,&f);
+      if(unsynced == 1 && w->periodic == 1) logwriter_sync(w,&f);
+      close(f.fd);
+      logwriter_file_open(w,&f,w->blockfd[cur]);
+      unsynced = 0;
+      failed = 0;
+    }
+
+    out = w->block[cur];
+    outlen = w->fill[cur];
+    if(w->compress > 0) {
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID,&zstart);
+      outlen = logwriter_deflate(&z,out,outlen,zbuf,zbufsize);
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID,&zend);
+      zcpu = logwriter_elapsed_us(&zstart,&zend);
+      out = zbuf;
+      if(outlen == 0) {
+        error(0,ERROR_PLUGIN,"log compression failed, block dropped");
+      }
+    }
+    if(w->frame == 1 && outlen > 0) {
+      memcpy(fbuf + sizeof(logframe_header_t),out,outlen);
+      out = fbuf;
+      outlen = logwriter_frame(&f,out,outlen);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    if(logwriter_file_write(w,&f,out,outlen) == 0) {
+      if(failed == 0) error(0,ERROR_PLUGIN,"log write failed: %s",
+                            strerror(errno));
+      failed = 1;
+    }
+    unsynced = 1;
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    if(w->periodic == 1 &&
+       logwriter_elapsed_us(&lastsync,&end) / 1000 >= w->sync_interval) {
+      logwriter_sync(w,&f);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      lastsync = end;
+      unsynced = 0;
+    }
+    lat = logwriter_elapsed_ns(&start,&end);
+    preallocs = f.preallocs;
+    f.preallocs = 0;
+
+    pthread_mutex_lock(&w->lock);
+    w->stats.preallocs += preallocs;
+    w->stats.blocks++;
+    w->stats.rawbytes += w->fill[cur];
+    w->stats.bytes += outlen;
+    w->stats.zcpu += zcpu;
+    w->stats.lat_last = lat;
+    w->stats.lat_total += lat;
+    if(lat > w->stats.lat_max) w->stats.lat_max = lat;
+    if(unsynced == 0 && w->periodic == 1) w->stats.syncs++;
+    w->written++;
+    w->stats.depth = w->filled - w->written;
+    pthread_cond_signal(&w->freed);
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  /* everything is written, make sure it's on disk before the file closes */
+  logwriter_file_finish(w,&f);
+  if(unsynced == 1 && w->periodic == 1) logwriter_sync(w,&f);
+  if(f.fd != w->fd) close(f.fd); /* switched to a file never written */
+  if(w->compress > 0) {
+    deflateEnd(&z);
+    free(zbuf);
+  }
+  free(fbuf);
+  free(f.page);
+  return NULL;
+}
+
+void logwriter_file_open(logwriter_t *w, logwriter_file_t *f, int fd) {
+  size_t tail;
+  f->fd = fd;
+  f->noalloc = 0;
+  f->preallocs = 0;
+  f->seq = 0;
+  if(w->prealloc == 0) return;
+  f->pos = lseek(fd,0,SEEK_END);
+  if(f->pos < 0) f->pos = 0;
+  f->allocated = f->pos;
+  f->synced = f->pos;
+  if(w->mmap == 1) return;
+  /* an existing file may end in a partial page, which gets rewritten */
+  tail = f->pos % w->align;
+  if(tail > 0 && pread(fd,f->page,tail,f->pos - tail) != (ssize_t)tail) {
+    memset(f->page,0,tail);
+  }
+}
+
+int logwriter_file_write(logwriter_t *w, logwriter_file_t *f, char *buf,
+                         size_t len) {
+  size_t tail, total, padded;
+  off_t pagestart;
+  char *cursor;
+  ssize_t n;
+
+  if(w->prealloc == 0) return logwriter_writeall(f->fd,buf,len);
+  if(w->mmap == 1) return logwriter_file_map(w,f,buf,len);
+
+  /* the staging buffer starts with the partial page left by the last write,
+     so every write starts and ends on a page boundary */
+  tail = f->pos % w->align;
+  pagestart = f->pos - tail;
+  memcpy(f->page + tail,buf,len);
+  total = tail + len;
+  padded = (total + w->align - 1) & ~(w->align - 1);
+  memset(f->page + total,0,padded - total);
+
+  /* reserve space a whole segment at a time.  the file size isn't changed,
+     so if we never get to trim the file, it is only padded to the end of the
+     last page rather than the end of the segment. */
+  while(f->noalloc == 0 && pagestart + (off_t)padded > f->allocated) {
+    if(fallocate(f->fd,FALLOC_FL_KEEP_SIZE,f->allocated,w->prealloc) != 0) {
+      error(0,ERROR_PLUGIN,"log preallocation failed: %s",strerror(errno));
+      f->noalloc = 1;
+      break;
+    }
+    f->allocated += w->prealloc;
+    f->preallocs++;
+  }
+
+  cursor = f->page;
+  while(cursor < f->page + padded) {
+    n = pwrite(f->fd,cursor,f->page + padded - cursor,
+               pagestart + (cursor - f->page));
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      return 0;
+    }
+    cursor += n;
+  }
+  f->pos += len;
+
+  /* keep the new partial page for next time */
+  memmove(f->page,f->page + total - total % w->align,total % w->align);
+  return 1;
+}
+
+int logwriter_file_map(logwriter_t *w, logwriter_file_t *f, char *buf,
+                       size_t len) {
+  size_t n;
+  void *map;
+  while(len > 0) {
+    /* past the end of the mapped segment, map the next one */
+    if(f->map == NULL || f->pos >= f->mapstart + (off_t)w->prealloc) {
+      if(f->map != NULL) munmap(f->map,w->prealloc);
+      f->map = NULL;
+      f->mapstart = f->pos - f->pos % w->prealloc;
+      /* a mapping past the end of the file can't be written, so extend the
+         file first, with real blocks if the filesystem supports it.  only
+         fall back to a sparse file if it doesn't; storing to a page there's
+         no room for raises SIGBUS, so if the disk is full the block is
+         dropped instead, just like a failed write. */
+      if(f->allocated < f->mapstart + (off_t)w->prealloc) {
+        if(f->noalloc == 0 &&
+           fallocate(f->fd,0,f->mapstart,w->prealloc) != 0) {
+          if(errno != EOPNOTSUPP && errno != ENOSYS) return 0;
+          error(0,ERROR_PLUGIN,"log preallocation failed: %s",
+                strerror(errno));
+          f->noalloc = 1;
+        }
+        if(f->noalloc == 1 &&
+           ftruncate(f->fd,f->mapstart + w->prealloc) != 0) return 0;
+        f->allocated = f->mapstart + w->prealloc;
+        f->preallocs++;
+      }
+      map = mmap(NULL,w->prealloc,PROT_READ | PROT_WRITE,MAP_SHARED,f->fd,
+                 f->mapstart);
+      if(map == MAP_FAILED) return 0;
+      f->map = map;
+    }
+    n = f->mapstart + w->prealloc - f->pos;
+    if(n > len) n = len;
+    memcpy(f->map + (f->pos - f->mapstart),buf,n);
+    f->pos += n;
+    buf += n;
+    len -= n;
+  }
+  return 1;
+}
+
+void logwriter_file_finish(logwriter_t *w, logwriter_file_t *f) {
+  if(w->prealloc == 0) return;
+  if(f->map != NULL) {
+    munmap(f->map,w->prealloc);
+    f->map = NULL;
+  }
+  if(ftruncate(f->fd,f->pos) != 0) {
+    error(0,ERROR_PLUGIN,"cannot trim log file: %s",strerror(errno));
+  }
+  /* the unmapped pages are still dirty in the page cache, and earlier
+     segments may never have been synced at all, so sync the whole file.  the
+     new length has to make it to disk too, or the data is past the end. */
+  if(w->mmap == 1 && f->synced < f->pos) {
+    if(w->syncmode == LOGWRITER_FSYNC) {
+      fsync(f->fd);
+    } else {
+      fdatasync(f->fd);
+    }
+    f->synced = f->pos;
+  }
+}
+
+int logwriter_writeall(int fd, char *buf, size_t len) {
+  ssize_t n;
+  while(len > 0) {
+    n = write(fd,buf,len);
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      return 0;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 1;
+}
+
+void logwriter_sync(logwriter_t *w, logwriter_file_t *f) {
+  off_t start;
+  if(w->mmap == 1) {
+    if(f->synced >= f->pos) return; /* already synced by file_finish */
+    /* only the pages written since the last sync */
+    if(f->map != NULL && f->synced >= f->mapstart) {
+      start = f->synced - f->synced % sysconf(_SC_PAGESIZE);
+      msync(f->map + (start - f->mapstart),f->pos - start,MS_SYNC);
+      f->synced = f->pos;
+      return;
+    }
+    /* some of it was in segments that are unmapped now.  an msync interval
+       syncs with NOSYNC too, so fall back to fdatasync for that. */
+    if(w->syncmode == LOGWRITER_FSYNC) {
+      fsync(f->fd);
+    } else {
+      fdatasync(f->fd);
+    }
+    f->synced = f->pos;
+    return;
+  }
+  if(w->syncmode == LOGWRITER_FDATASYNC) {
+    fdatasync(f->fd);
+  } else if(w->syncmode == LOGWRITER_FSYNC) {
+    fsync(f->fd);
+  }
+  f->synced = f->pos;
+}
+
+size_t logwriter_deflate(z_stream *z, char *in, size_t len, char *out,
+                         size_t outsize) {
+  /* each block starts a fresh gzip member with its own header and crc */
+  deflateReset(z);
+  z->next_in = (Bytef *)in;
+  z->avail_in = len;
+  z->next_out = (Bytef *)out;
+  z->avail_out = outsize;
+  if(deflate(z,Z_FINISH) != Z_STREAM_END) return 0;
+  return outsize - z->avail_out;
+}
+
+size_t logwriter_frame(logwriter_file_t *f, char *out, size_t len) {
+  logframe_header_t h;
+  uLong crc;
+  memcpy(h.magic,LOGFRAME_MAGIC,sizeof(h.magic));
+  h.seq = f->seq;
+  h.length = len;
+  crc = crc32(0L,(Bytef *)&h.seq,sizeof(h.seq) + sizeof(h.length));
+  crc = crc32(crc,(Bytef *)out + sizeof(logframe_header_t),len);
+  h.crc = crc;
+  memcpy(out,&h,sizeof(logframe_header_t));
+  f->seq++;
+  return len + sizeof(logframe_header_t);
+}
+
+uint64_t logwriter_elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000 +
+         (b->tv_nsec - a->tv_nsec);
+}
+
+uint64_t logwriter_elapsed_us(struct timespec *a, struct timespec *b) {
+  return logwriter_elapsed_ns(a,b) / 1000;
+}
@@ -0,0 +1,136 @@
+#ifndef _LOGWRITER_H
+#define _LOGWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/************ SCOPE *********************************
+  Asynchronous block writer for log files.  The
+  caller appends formatted data into a ring of
+  fixed size blocks, and a dedicated thread writes
+  full blocks to disk, so that slow storage never
+  stalls the thread that consumes records.  The
+  writer thread can also compress each block.
+****************************************************/
+
+/* how the writer thread commits data to storage */
+typedef enum _logwriter_syncmode {
+  LOGWRITER_NOSYNC = 0,   /* leave it to the kernel */
+  LOGWRITER_FSYNC = 1,    /* fsync() every sync interval */
+  LOGWRITER_FDATASYNC = 2 /* fdatasync() every sync interval */
+} logwriter_syncmode_t;
+
+/* writer settings */
+typedef struct _logwriter_conf {
+  size_t blocksize;       /* size of each block in bytes */
+  unsigned int n_blocks;  /* number of blocks in the ring, at least 2 */
+  unsigned long flush_interval; /* ms before a partial block is handed off,
+                                   0 hands off every append immediately */
+  logwriter_syncmode_t syncmode;
+  unsigned long sync_interval;  /* ms between syncs, 0 syncs every block */
+  int compress;           /* zlib compression level, 0 for none */
+  size_t prealloc;        /* bytes to preallocate at a time, 0 for none */
+  size_t align;           /* write alignment when preallocating */
+  int mmap;               /* copy blocks into a mapping of the file */
+  unsigned long msync_interval; /* ms between msyncs in mmap mode whatever
+                                   the sync mode, 0 leaves it to that */
+  int frame;              /* write each block as a checksummed frame */
+} logwriter_conf_t;
+
+/* writer statistics, a snapshot is taken by logwriter_get_stats */
+typedef struct _logwriter_stats {
+  unsigned int depth;       /* blocks queued for writing right now */
+  unsigned int maxdepth;    /* the most blocks ever queued at once */
+  unsigned long blocks;     /* blocks written */
+  unsigned long rawbytes;   /* bytes appended, before compression */
+  unsigned long bytes;      /* bytes written */
+  uint64_t zcpu;            /* cpu time spent compressing, in microseconds */
+  unsigned long syncs;      /* fsync, fdatasync or msync calls */
+  unsigned long stalls;     /* times the caller waited for a free block */
+  uint64_t lat_last;        /* latency of the last write in nanoseconds */
+  uint64_t lat_max;         /* worst write latency in nanoseconds */
+  uint64_t lat_total;       /* sum of write latency, for an average */
+  unsigned long preallocs;  /* preallocated or mapped segments */
+} logwriter_stats_t;
+
+typedef struct _logwriter {
+  int fd;                 /* file new blocks are written to */
+  size_t blocksize;       /* size of each block in bytes */
+  unsigned int n_blocks;  /* number of blocks in the ring */
+  char **block;           /* the ring of blocks */
+  size_t *fill;           /* bytes used in each block */
+  int *blockfd;           /* file each queued block is written to */
+  unsigned long filled;   /* blocks handed to the writer thread, ever */
+  unsigned long written;  /* blocks the writer thread has finished */
+  unsigned long flush_interval; /* ms before a partial block is handed off */
+  unsigned long sync_interval;  /* ms between syncs, 0 syncs every block */
+  logwriter_syncmode_t syncmode;
+  int periodic;           /* sync every sync_interval, by the sync mode or an
+                             msync interval */
+  int compress;           /* zlib compression level, 0 for none */
+  size_t prealloc;        /* bytes to preallocate at a time, 0 for none */
+  size_t align;           /* write alignment when preallocating */
+  int mmap;               /* copy blocks into a mapping of the file */
+  int frame;              /* write each block as a checksummed frame */
+  struct timespec lastflush; /* when a block was last handed off */
+  int closing;            /* set to stop the writer thread */
+  logwriter_stats_t stats;
+  pthread_mutex_t lock;   /* protects filled, written, closing and stats */
+  pthread_cond_t queued;  /* signalled when a block is handed off */
+  pthread_cond_t freed;   /* signalled when a block has been written */
+  pthread_t thread;
+} logwriter_t;
+
+/* create a writer for an open file descriptor and start its thread.
+
+   with a compress level of 1-9, each block is written as a separate gzip
+   member, so the file is a valid gzip stream that can be read up to the last
+   complete block if it is cut short.
+
+   with prealloc set, space is reserved prealloc bytes at a time with
+   fallocate, and the file is written with pwrite in whole multiples of align
+   bytes at aligned offsets.  a partly filled last page is padded with zeros
+   and rewritten in place by the next write.  the file is truncated to the
+   real data length when it is switched or closed, which also releases the
+   unused reservation, so it must not be opened with O_APPEND.
+
+   with mmap set, the file is extended and mapped prealloc bytes at a time,
+   and blocks are copied into the mapping rather than written, leaving
+   writeback to the kernel.  a sync is an msync of the data written since
+   the last one, done every msync_interval if that is set, whatever the sync
+   mode, and every sync_interval otherwise.  a switch or close always syncs
+   the old file before it is closed.  with NOSYNC and no msync interval there
+   is no durability point in between, and a power cut can lose everything
+   since the file was opened.  the file must be opened O_RDWR and not
+   O_APPEND, and is truncated to the real data length like a preallocated
+   one.  prealloc defaults to 1MB in this mode.
+
+   with frame set, each block, after compression, is written behind a
+   logframe_header_t with its length and crc, see logformat.h.  with a
+   flush interval and sync mode set, this bounds what a power cut can lose
+   to the data appended in the last flush interval plus sync interval, and
+   everything before that can be salvaged even from a torn file. */
+logwriter_t *logwriter_create(int fd, logwriter_conf_t *c);
+
+/* append len bytes.  the data never spans a block boundary, so a record
+   appended in one call is always written with a single write().  if the
+   ring is full, this blocks until the writer thread frees a block. */
+void logwriter_append(logwriter_t *w, char *data, size_t len);
+
+/* hand off the current block even if it is not full */
+void logwriter_flush(logwriter_t *w);
+
+/* direct everything appended from now on to a new file.  the old file is
+   synced and closed by the writer thread once its last block is written, so
+   this never waits on the disk. */
+void logwriter_switch(logwriter_t *w, int fd);
+
+/* flush, wait for all data to be written and synced, stop the thread, close
+   the file and free the writer. */
+void logwriter_close(logwriter_t *w);
+
+/* get a consistent copy of the writer statistics */
+void logwriter_get_stats(logwriter_t *w, logwriter_stats_t *out);
+
+#endif
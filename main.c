@@ -24,6 +24,7 @@
 
 typedef struct _aldl_threads_t {
   pthread_t acq;
+  pthread_t rx;
   pthread_t consoleif;
   pthread_t datalogger;
   pthread_t remote;
@@ -66,7 +67,7 @@ int main(int argc, char **argv) {
 
   /* ------- start threads ----------- */
   aldl_threads_t *thread = smalloc(sizeof(aldl_threads_t)); /* thread spc */
-  acq_start(thread,aldl); /* start acquisition thread */
+  acq_start(thread,aldl); /* start serial reader and acquisition threads */
   modules_start(thread,aldl); /* start all other modules */
   pthread_join(thread->acq,NULL); /* pause main thread until acq dies */
 
@@ -141,8 +142,10 @@ void acq_start(aldl_threads_t *thread, aldl_conf_t *aldl) {
   pthread_attr_getschedparam(&acq_attr,&acq_param);
   acq_param.sched_priority = ACQ_PRIORITY;
   pthread_attr_setschedparam(&acq_attr,&acq_param);
+  pthread_create(&thread->rx,&acq_attr,rx_thread,NULL);
   pthread_create(&thread->acq,&acq_attr,aldl_acq,(void *)aldl);
   #else
+  pthread_create(&thread->rx,NULL,rx_thread,NULL);
   pthread_create(&thread->acq,NULL,aldl_acq,(void *)aldl);
   #endif
 }
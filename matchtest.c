@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aldl-types.h"
+#include "useful.h"
+
+/************ SCOPE *********************************
+  Checks the stream matcher in useful.c against a
+  brute force search, with the stream split into
+  chunks every which way, and times it against the
+  rescan that listen_bytes used to do, hunting for
+  an echo through noisy idle chatter.  Run by
+  make test, exits nonzero on any mismatch.
+****************************************************/
+
+/* random trials for the unit test */
+#define MATCHTEST_TRIALS 200000
+
+/* the longest random haystack and needle.  needles go past RF_MATCH_INLINE
+   so both the inline and allocated tables are covered. */
+#define MATCHTEST_MAXHAYSTACK 64
+#define MATCHTEST_MAXNEEDLE (RF_MATCH_INLINE + 4)
+
+/* bytes of chatter before the echo, and listens timed, in the benchmark */
+#define MATCHTEST_CHATTER 2000
+#define MATCHTEST_LISTENS 2000
+
+/* end of the first match of n in h at or after start, or 0 if none */
+int brute_match(byte *h, int hsize, byte *n, int nsize, int start);
+
+/* cmp_bytestring as it was before the stream matcher.  it restarts the
+   needle from scratch on a mismatch, so it misses overlapping matches. */
+int rescan_cmp(byte *h, int hsize, byte *n, int nsize);
+
+/* feed h to a matcher in chunks of 1 to maxchunk bytes, or exactly chunk
+   bytes if chunk > 0, and check every match it reports against brute force.
+   returns the number of mismatches. */
+int check_split(byte *h, int hsize, byte *n, int nsize, int chunk,
+                int maxchunk);
+
+/* fill a buffer with idle chatter, with some bytes and partial matches of
+   the echo mixed in, so the rescan has to back off often */
+void make_chatter(byte *buf, int len, byte *echo, int echolen);
+
+/* time the old rescan and the stream matcher listening for the echo at the
+   end of buf, as listen_bytes would, in microseconds per listen */
+double bench_rescan(byte *buf, int len, byte *echo, int echolen);
+double bench_stream(byte *buf, int len, byte *echo, int echolen);
+
+double now_us();
+
+int main(int argc, char **argv) {
+  byte h[MATCHTEST_MAXHAYSTACK];
+  byte n[MATCHTEST_MAXNEEDLE];
+  int hsize, nsize, alphabet;
+  int trial, x, chunk;
+  int bad = 0; /* stream matcher mismatches */
+  int badcmp = 0; /* cmp_bytestring mismatches */
+  int rescanmissed = 0; /* the old rescan, for reference only */
+  int found;
+
+  srand(7);
+  for(trial=0;trial<MATCHTEST_TRIALS;trial++) {
+    /* a small alphabet makes repeats and overlapping partial matches common */
+    alphabet = 1 + rand() % 3;
+    hsize = 1 + rand() % MATCHTEST_MAXHAYSTACK;
+    nsize = 1 + rand() % ( trial % 8 == 0 ? MATCHTEST_MAXNEEDLE : 6 );
+    for(x=0;x<hsize;x++) h[x] = rand() % alphabet;
+    for(x=0;x<nsize;x++) n[x] = rand() % alphabet;
+
+    /* random chunks, and every fixed chunk size up to a few */
+    bad += check_split(h,hsize,n,nsize,0,8);
+    for(chunk=1;chunk<=4;chunk++) bad += check_split(h,hsize,n,nsize,chunk,0);
+
+    found = ( brute_match(h,hsize,n,nsize,0) > 0 ) ? 1 : 0;
+    if(cmp_bytestring(h,hsize,n,nsize) != found) badcmp++;
+    if(rescan_cmp(h,hsize,n,nsize) != found) rescanmissed++;
+  }
+  printf("unit: %i trials, %i stream mismatches, %i cmp_bytestring "
+         "mismatches (old rescan missed %i)\n",
+         MATCHTEST_TRIALS,bad,badcmp,rescanmissed);
+
+  /* a data request echo, as the acq loop listens for */
+  byte echo[5] = { 0xF4, 0x57, 0x01, 0x00, 0xB4 };
+  byte *chatter = malloc(MATCHTEST_CHATTER + sizeof(echo));
+  make_chatter(chatter,MATCHTEST_CHATTER,echo,sizeof(echo));
+  memcpy(chatter + MATCHTEST_CHATTER,echo,sizeof(echo));
+  double t_rescan = bench_rescan(chatter,MATCHTEST_CHATTER + sizeof(echo),
+                                 echo,sizeof(echo));
+  double t_stream = bench_stream(chatter,MATCHTEST_CHATTER + sizeof(echo),
+                                 echo,sizeof(echo));
+  printf("bench: echo after %i bytes of chatter, rescan %.1fus, "
+         "stream %.2fus per listen\n",MATCHTEST_CHATTER,t_rescan,t_stream);
+  free(chatter);
+
+  if(bad > 0 || badcmp > 0 || t_stream < 0 || t_rescan < 0) {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
+
+int brute_match(byte *h, int hsize, byte *n, int nsize, int start) {
+  int x;
+  for(x=start;x+nsize<=hsize;x++) {
+    if(memcmp(h + x,n,nsize) == 0) return x + nsize;
+  }
+  return 0;
+}
+
+int rescan_cmp(byte *h, int hsize, byte *n, int nsize) {
+  if(nsize > hsize) return 0;
+  if(hsize < 1 || nsize < 1) return 0;
+  int cursor = 0;
+  int matched = 0;
+  while(cursor <= hsize) {
+    if(nsize == matched) return 1;
+    if(h[cursor] != n[matched]) {
+      matched = 0;
+    } else {
+      matched++;
+    }
+    cursor++;
+  }
+  return 0;
+}
+
+int check_split(byte *h, int hsize, byte *n, int nsize, int chunk,
+                int maxchunk) {
+  rf_match_t m;
+  int pos = 0; /* bytes fed so far */
+  int from = 0; /* where the matcher started over */
+  int want, got, used, len;
+  int bad = 0;
+
+  rf_match_init(&m,n,nsize);
+  want = brute_match(h,hsize,n,nsize,from);
+  while(pos < hsize) {
+    len = ( chunk > 0 ) ? chunk : 1 + rand() % maxchunk;
+    if(len > hsize - pos) len = hsize - pos;
+    used = rf_match_feed(&m,h + pos,len);
+    if(used > 0) {
+      got = pos + used;
+      if(got != want) bad++;
+      /* the matcher starts over after a match, and so does brute force */
+      pos = got;
+      from = got;
+      want = brute_match(h,hsize,n,nsize,from);
+    } else {
+      pos += len;
+    }
+  }
+  if(want != 0) bad++; /* a match was never reported */
+  rf_match_free(&m);
+  return bad;
+}
+
+void make_chatter(byte *buf, int len, byte *echo, int echolen) {
+  int x = 0;
+  int r, part;
+  while(x < len) {
+    r = rand() % 10;
+    if(r < 6) {
+      buf[x++] = 0x33; /* idle byte */
+    } else if(r < 8) { /* the start of the echo, cut short */
+      part = 1 + rand() % ( echolen - 1 );
+      if(part > len - x) part = len - x;
+      memcpy(buf + x,echo,part);
+      x += part;
+    } else {
+      buf[x++] = rand();
+    }
+  }
+}
+
+double bench_rescan(byte *buf, int len, byte *echo, int echolen) {
+  int rep, got, want;
+  int found = 0;
+  double start = now_us();
+  for(rep=0;rep<MATCHTEST_LISTENS;rep++) {
+    /* the old listen_bytes read up to the echo length, and then a byte at a
+       time, rescanning everything read so far after each read */
+    got = 0;
+    while(got < len) {
+      want = ( got < echolen ) ? echolen - got : 1;
+      got += want;
+      if(rescan_cmp(buf,got,echo,echolen) == 1) {
+        found++;
+        break;
+      }
+    }
+  }
+  if(found != MATCHTEST_LISTENS) return -1;
+  return ( now_us() - start ) / MATCHTEST_LISTENS;
+}
+
+double bench_stream(byte *buf, int len, byte *echo, int echolen) {
+  int rep, got, want;
+  int found = 0;
+  rf_match_t m;
+  double start = now_us();
+  for(rep=0;rep<MATCHTEST_LISTENS;rep++) {
+    /* listen_bytes reads what could finish the match, and feeds only that */
+    rf_match_init(&m,echo,echolen);
+    got = 0;
+    while(got < len) {
+      want = echolen - m.state;
+      if(want > len - got) want = len - got;
+      if(rf_match_feed(&m,buf + got,want) > 0) {
+        found++;
+        break;
+      }
+      got += want;
+    }
+    rf_match_free(&m);
+  }
+  if(found != MATCHTEST_LISTENS) return -1;
+  return ( now_us() - start ) / MATCHTEST_LISTENS;
+}
+
+double now_us() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+}
@@ -213,13 +213,13 @@ void *mode4_init(void *aldl_in) {
 }
 
 void get_engine_status() {
-  engine_status.rpm = rec->data[p_idx.rpm].f;
-  engine_status.idletarget = rec->data[p_idx.idletarget].f;
-  engine_status.iacsteps = rec->data[p_idx.iacsteps].i;
-  engine_status.cooltemp = rec->data[p_idx.cooltemp].f;
-  engine_status.map = rec->data[p_idx.map].f;
-  engine_status.adv = rec->data[p_idx.adv].i;
-  engine_status.kr = rec->data[p_idx.kr].f;
+  engine_status.rpm = record_get(aldl,rec,p_idx.rpm).f;
+  engine_status.idletarget = record_get(aldl,rec,p_idx.idletarget).f;
+  engine_status.iacsteps = record_get(aldl,rec,p_idx.iacsteps).i;
+  engine_status.cooltemp = record_get(aldl,rec,p_idx.cooltemp).f;
+  engine_status.map = record_get(aldl,rec,p_idx.map).f;
+  engine_status.adv = record_get(aldl,rec,p_idx.adv).i;
+  engine_status.kr = record_get(aldl,rec,p_idx.kr).f;
 }
 
 char *print_engine_status() {
@@ -5,6 +5,11 @@ void consoleif_exit();
 /* the standard full-time datalogger */
 void *datalogger_init(void *aldl_in);
 
+/* format the given channels of a record as a csv log line into buf, and
+   return its length.  floats get DATALOGGER_PRECISION (2) places. */
+size_t datalogger_csv_line(aldl_conf_t *aldl, aldl_record_t *rec,
+                           int *channel, int n_channels, char *buf);
+
 /* the 'remote' scripting interface */
 void *remote_init(void *aldl_in);
 
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -22,10 +23,40 @@
 /****************GLOBALSn'STRUCTURES*****************************/
 
 unsigned char *databuff;
-char txmode;
+
+/* bytes the fake ecm is sending, each with the time it finishes arriving at
+   the baud rate.  serial_write queues the line echo and any reply, and
+   serial_read hands over whatever has arrived by then, so it behaves like a
+   real byte stream no matter how it's read. */
+byte *dummyq;
+timespec_t *dummydue;
+int dummyhead, dummytail; /* queue positions, mod DUMMY_QUEUE */
+timespec_t dummyquiet; /* no idle traffic until then, after a shutup */
+timespec_t dummyidle; /* when the next idle traffic byte is due */
+pthread_mutex_t dummylock; /* protects all of the above */
+pthread_cond_t dummycond; /* signalled when serial_write queues bytes */
+
+/* microseconds per byte */
+#define DUMMY_BYTE_US ( SERIAL_BYTES_PER_MS * 1000 )
 
 void gen_pkt();
 
+/* queue bytes to be sent after anything already queued, lock held */
+void dummy_send(byte *str, int len);
+
+/* take up to len bytes that have arrived, lock held */
+int dummy_take(byte *str, int len);
+
+/* when the next n bytes will have arrived, or as many as are queued.  with
+   nothing queued, when idle traffic is next due.  lock held. */
+timespec_t dummy_wake(int n);
+
+/* 1 if timestamp a is later than b */
+int dummy_later(timespec_t a, timespec_t b);
+
+/* add n byte times to a timestamp */
+void dummy_bytetime(timespec_t *t, int n);
+
 /****************FUNCTIONS**************************************/
 
 void serial_close() {
@@ -59,23 +90,113 @@ int serial_init(char *port) {
   #ifdef SERIAL_VERBOSE
   printf("Serial dummy driver initialized!\n");
   #endif
-  txmode=0;
-  databuff=malloc(64);
+  databuff = malloc(64);
+  dummyq = malloc(DUMMY_QUEUE);
+  dummydue = malloc(sizeof(timespec_t) * DUMMY_QUEUE);
+  dummyhead = 0;
+  dummytail = 0;
+  dummyidle = get_time();
+  dummyquiet = dummyidle;
+  pthread_mutex_init(&dummylock,NULL);
+  #ifdef USEFUL_BETTERCLOCK
+  /* due times are on the monotonic clock, so the wait must be too */
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr,_CLOCKSOURCE);
+  pthread_cond_init(&dummycond,&attr);
+  pthread_condattr_destroy(&attr);
+  #else
+  pthread_cond_init(&dummycond,NULL);
+  #endif
   return 1;
 }
 
-void serial_purge() {
-  #ifdef SERIAL_VERBOSE
-  printf("SERIAL PURGE RX/TX (Dummy Ignored)\n");
+int dummy_later(timespec_t a, timespec_t b) {
+  if(a.tv_sec != b.tv_sec) return (a.tv_sec > b.tv_sec) ? 1 : 0;
+  #ifdef USEFUL_BETTERCLOCK
+  return (a.tv_nsec > b.tv_nsec) ? 1 : 0;
+  #else
+  return (a.tv_usec > b.tv_usec) ? 1 : 0;
   #endif
-  return;
+}
+
+void dummy_bytetime(timespec_t *t, int n) {
+  #ifdef USEFUL_BETTERCLOCK
+  t->tv_nsec += n * DUMMY_BYTE_US * 1000;
+  while(t->tv_nsec >= 1000000000) {
+    t->tv_sec++;
+    t->tv_nsec -= 1000000000;
+  }
+  #else
+  t->tv_usec += n * DUMMY_BYTE_US;
+  while(t->tv_usec >= 1000000) {
+    t->tv_sec++;
+    t->tv_usec -= 1000000;
+  }
+  #endif
+}
+
+void dummy_send(byte *str, int len) {
+  timespec_t now = get_time();
+  timespec_t t;
+  int x;
+  /* start after the last queued byte, or now if the line is idle */
+  t = now;
+  if(dummyhead != dummytail) {
+    t = dummydue[(dummyhead + DUMMY_QUEUE - 1) % DUMMY_QUEUE];
+    if(dummy_later(now,t) == 1) t = now;
+  }
+  for(x=0;x<len;x++) {
+    if((dummyhead + 1) % DUMMY_QUEUE == dummytail) return; /* full */
+    dummy_bytetime(&t,1);
+    dummyq[dummyhead] = str[x];
+    dummydue[dummyhead] = t;
+    dummyhead = (dummyhead + 1) % DUMMY_QUEUE;
+  }
+}
+
+timespec_t dummy_wake(int n) {
+  int queued = (dummyhead + DUMMY_QUEUE - dummytail) % DUMMY_QUEUE;
+  if(queued > 0) {
+    if(n > queued) n = queued;
+    return dummydue[(dummytail + n - 1) % DUMMY_QUEUE];
+  }
+  return (dummy_later(dummyquiet,dummyidle) == 1) ? dummyquiet : dummyidle;
+}
+
+int dummy_take(byte *str, int len) {
+  timespec_t now = get_time();
+  byte idle = 0x33;
+  int n = 0;
+  /* idle traffic every packet's worth of bytes, unless told to shut up */
+  if(dummy_later(now,dummyquiet) == 1 && dummyhead == dummytail &&
+     dummy_later(now,dummyidle) == 1) {
+    dummy_send(&idle,1);
+    dummyidle = dummydue[(dummyhead + DUMMY_QUEUE - 1) % DUMMY_QUEUE];
+    dummy_bytetime(&dummyidle,63);
+  }
+  while(n < len && dummyhead != dummytail &&
+        dummy_later(dummydue[dummytail],now) == 0) {
+    str[n] = dummyq[dummytail];
+    dummytail = (dummytail + 1) % DUMMY_QUEUE;
+    n++;
+  }
+  return n;
+}
+
+void serial_purge() {
+  serial_purge_rx();
 }
 
 void serial_purge_rx() {
+  /* drop what has arrived, anything still on the wire keeps coming */
+  byte discard[64];
+  pthread_mutex_lock(&dummylock);
+  while(dummy_take(discard,64) > 0);
+  pthread_mutex_unlock(&dummylock);
   #ifdef SERIAL_VERBOSE
-  printf("SERIAL PURGE RX (Dummy Ignored)\n");
+  printf("SERIAL PURGE RX\n");
   #endif
-  return;
 }
 
 void serial_purge_tx() {
@@ -90,65 +211,58 @@ int serial_write(byte *str, int len) {
   printf("WRITE: ");
   printhexstring(str,len); 
   #endif
-  /* determine mode */
-  if(len == 4 && str[0] == 0xF4 && str[1] == 0x56 && \
-     str[2] == 0x08 && str[3] == 0xAE) {
-     txmode = 1;
-  }
-  return 0;
-}
-
-inline int serial_read(byte *str, int len) {
-  if(txmode == 0) { /* idle traffic req */
-    usleep(SERIAL_BYTES_PER_MS * 64 * 1000); /* fake baud delay */
-    str[0] = 0x33;
-    txmode++;
-    #ifdef SERIAL_VERBOSE
-    printf("DUMMY MODE: Idle Traffic Req: ");
-    printhexstring(str,1);
-    #endif
-    return 1;
-  } if(txmode == 1) { /* shutup req */
-    usleep(SERIAL_BYTES_PER_MS * 5 * 1000); /* fake baud delay */
-    str[0] = 0xF4;
-    str[1] = 0x56;
-    str[2] = 0x08;
-    str[3] = 0xAE;
-    txmode++;
-    #ifdef SERIAL_VERBOSE
-    printf("DUMMY MODE: Silence Request: ");
-    printhexstring(str,4);
-    #endif
-    return 4;
-  } if(txmode == 2) { /* data request reply */
-    usleep(SERIAL_BYTES_PER_MS * 5 * 1000); /* fake baud delay */
-    txmode = 3; 
-    str[0] = 0xF4;
-    str[1] = 0x57;
-    str[2] = 0x01;
-    str[3] = 0x00;
-    str[4] = 0xB4;
-    #ifdef SERIAL_VERBOSE
-    printf("DUMMY MODE: Data Req. Reply: ");
-    printhexstring(str,5);
-    #endif
-    return 5;
-  } if(txmode == 3) { /* data send */
-    usleep(SERIAL_BYTES_PER_MS * len * 1000); /* fake baud delay */
-    txmode = 2;
+  pthread_mutex_lock(&dummylock);
+  dummy_send(str,len); /* the line echoes everything */
+  if(len >= 4 && str[2] == 0x08) { /* shutup req */
+    dummyquiet = get_deadline(DUMMY_SHUTUP_TIME);
+  } else if(len >= 4 && str[2] == 0x00) { /* return to normal mode */
+    dummyquiet = get_time();
+  } else if(len == 5 && str[2] == 0x01) { /* data request */
     gen_pkt();
     #ifdef SERIAL_VERBOSE
     printf("DUMMY MODE: Generated packet...\n");
     #endif
-    int x;
-    for(x=0;x<len;x++) {
-      str[x] = databuff[x]; 
-    }
-    return len;
+    dummy_send(databuff,64);
   }
+  pthread_cond_broadcast(&dummycond);
+  pthread_mutex_unlock(&dummylock);
   return 0;
 }
 
+int serial_read(byte *str, int len) {
+  int n;
+  pthread_mutex_lock(&dummylock);
+  n = dummy_take(str,len);
+  pthread_mutex_unlock(&dummylock);
+  if(n == 0) usleep(DUMMY_BYTE_US); /* nothing yet, don't spin */
+  return n;
+}
+
+int serial_read_until(byte *str, int len, timespec_t deadline) {
+  int got = 0;
+  timespec_t wake;
+  struct timespec until;
+  pthread_mutex_lock(&dummylock);
+  while(1) {
+    got += dummy_take(str + got,len - got);
+    if(got >= len) break;
+    if(get_remaining_us(deadline) == 0) break;
+    /* every due time is known up front, so sleep once until the read can
+       finish.  a write from the other thread queues bytes and wakes us. */
+    wake = dummy_wake(len - got);
+    if(dummy_later(wake,deadline) == 1) wake = deadline;
+    #ifdef USEFUL_BETTERCLOCK
+    until = wake;
+    #else
+    until.tv_sec = wake.tv_sec;
+    until.tv_nsec = wake.tv_usec * 1000;
+    #endif
+    pthread_cond_timedwait(&dummycond,&dummylock,&until);
+  }
+  pthread_mutex_unlock(&dummylock);
+  return got;
+}
+
 void serial_help_devs() {
   error(1,ERROR_GENERAL,"this serial driver has no devices......");
 }
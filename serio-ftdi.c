@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <ftdi.h>
 
@@ -26,12 +27,17 @@
 /* global ftdi context pointer */
 struct ftdi_context *ftdi;
 
-/* simple connection state status bit */
+/* simple connection state status bit, read from any thread */
 byte ftdistatus;
 
-/* number of failed io attempts */
+/* number of failed io attempts, from either thread */
 int iofail;
 
+/* the rx thread reads while the acq thread writes, so io takes this shared,
+   and recovery takes it alone, so the ftdi context is never freed under a
+   call in progress on the other thread */
+pthread_rwlock_t ftdilock = PTHREAD_RWLOCK_INITIALIZER;
+
 /* storage for serial init string */
 char *serialstr;
 
@@ -49,6 +55,11 @@ inline int ftdierror(int loc,int errno); /* prints error but continues */
 inline void ftdifatal(int loc,int errno); /* bails entirely on error */
 inline int ftdierror_counter(int loc,int errno); /* counts errors + recovery */
 
+/* take ftdilock around io, and release it after.  after too many failures,
+   the next io on either thread enters recovery first. */
+void ftdi_io_begin();
+void ftdi_io_end();
+
 /* enter recovery mode */
 inline void ftdi_recovery();
 
@@ -58,6 +69,7 @@ void serial_close() {
   if(ftdistatus > 0) {
     ftdi_usb_close(ftdi);
     ftdi_free(ftdi);
+    __atomic_store_n(&ftdistatus,0,__ATOMIC_SEQ_CST);
   }
 }
 
@@ -66,8 +78,8 @@ int serial_init(char *port) {
   printf("serial_init opening port @ %s with method ftdi\n",port);
   #endif
 
-  ftdistatus = 0;
-  iofail = 0;
+  __atomic_store_n(&ftdistatus,0,__ATOMIC_SEQ_CST);
+  __atomic_store_n(&iofail,0,__ATOMIC_SEQ_CST);
   int res = -1;
   serialstr = port;
 
@@ -101,26 +113,32 @@ int serial_init(char *port) {
   /* set latency timer */
   ftdierror(3,ftdi_set_latency_timer(ftdi,2));
 
-  ftdistatus = 1;
+  __atomic_store_n(&ftdistatus,1,__ATOMIC_SEQ_CST);
   return 1;
 }
 
 void serial_purge() {
+  ftdi_io_begin();
   ftdierror_counter(88,ftdi_usb_purge_buffers(ftdi));
+  ftdi_io_end();
   #ifdef SERIAL_VERBOSE
   printf("SERIAL PURGE RX/TX\n");
   #endif
 }
 
 void serial_purge_rx() {
+  ftdi_io_begin();
   ftdierror_counter(88,ftdi_usb_purge_rx_buffer(ftdi));
+  ftdi_io_end();
   #ifdef SERIAL_VERBOSE
   printf("SERIAL PURGE RX\n");
   #endif
 }
 
 void serial_purge_tx() {
+  ftdi_io_begin();
   ftdierror_counter(88,ftdi_usb_purge_tx_buffer(ftdi));
+  ftdi_io_end();
   #ifdef SERIAL_VERBOSE
   printf("SERIAL PURGE TX\n");
   #endif
@@ -141,7 +159,9 @@ int serial_write(byte *str, int len) {
   printhexstring(str,len);
   #endif
 
+  ftdi_io_begin();
   ftdierror_counter(6,ftdi_write_data(ftdi,(unsigned char *)str,len));
+  ftdi_io_end();
   return 0;
 }
 
@@ -156,8 +176,10 @@ int serial_read(byte *str, int len) {
     }
   #endif
   int resp = 0; /* to store response from whatever read */
+  ftdi_io_begin();
   resp = ftdi_read_data(ftdi,(unsigned char *)str,len);
   ftdierror_counter(22,resp);
+  ftdi_io_end();
   #ifdef SERIAL_SUPERVERBOSE
   if(resp > 0) {
     printf("READ %i of %i bytes: ",resp,len);
@@ -170,6 +192,28 @@ int serial_read(byte *str, int len) {
   return resp; /* return number of bytes read, or zero */
 }
 
+int serial_read_until(byte *str, int len, timespec_t deadline) {
+  int got = 0;
+  int resp;
+  /* ftdi_read_data waits on the usb bulk transfer, and the chip answers
+     that at least every latency timer period even with nothing to send, so
+     this loop doesn't spin while waiting.  it gives up early on too many
+     failures, so recovery doesn't wait for the deadline. */
+  ftdi_io_begin();
+  do {
+    resp = ftdi_read_data(ftdi,(unsigned char *)str + got,len - got);
+    if(ftdierror_counter(22,resp) == 0) got += resp;
+  } while(got < len && get_remaining_us(deadline) > 0 &&
+          __atomic_load_n(&iofail,__ATOMIC_SEQ_CST) <= FTDI_MAXFAIL);
+  ftdi_io_end();
+  #ifdef SERIAL_SUPERVERBOSE
+  printf("READ_UNTIL %i of %i bytes: ",got,len);
+  printhexstring(str,got);
+  #endif
+
+  return got;
+}
+
 inline void ftdifatal(int loc,int errno) {
   if(ftdierror(loc,errno) > 0) {
     error(1,ERROR_FTDI,"*** See above FTDI DRIVER error message @ stderr");
@@ -189,27 +233,42 @@ inline int ftdierror(int loc,int errno) {
 
 inline int ftdierror_counter(int loc,int errno) {
   if(errno>=0) { /* no error */
-    iofail = 0;
+    __atomic_store_n(&iofail,0,__ATOMIC_SEQ_CST);
     return 0;
   } else {
-    iofail++;
+    __atomic_add_fetch(&iofail,1,__ATOMIC_SEQ_CST);
     #ifdef SERIAL_VERBOSE
     fprintf(stderr,"FTDI DRIVER: %i, %s\n",errno,ftdi_get_error_string(ftdi));
     #endif
-    if(iofail > FTDI_MAXFAIL) ftdi_recovery();
     return 1;
   }
 }
 
+void ftdi_io_begin() {
+  /* recover before taking the lock shared, so both threads end up waiting
+     for it here, and neither holds it when recovery runs */
+  if(__atomic_load_n(&iofail,__ATOMIC_SEQ_CST) > FTDI_MAXFAIL) ftdi_recovery();
+  pthread_rwlock_rdlock(&ftdilock);
+}
+
+void ftdi_io_end() {
+  pthread_rwlock_unlock(&ftdilock);
+}
+
 inline void ftdi_recovery() {
   #ifdef FTDI_ATTEMPT_RECOVERY
-  ftdistatus=0;
+  /* waits for the other thread to finish its io, and it may have recovered
+     already by the time this gets the lock */
+  pthread_rwlock_wrlock(&ftdilock);
+  if(__atomic_load_n(&iofail,__ATOMIC_SEQ_CST) > FTDI_MAXFAIL) {
     #ifdef SERIAL_VERBOSE
     fprintf(stderr,"FTDI DRIVER: Triggered recovery mode...\n");
     #endif
-  serial_close();
-  msleep(500);
-  serial_init(serialstr);
+    serial_close();
+    msleep(500);
+    serial_init(serialstr);
+  }
+  pthread_rwlock_unlock(&ftdilock);
   #endif
 }
 
@@ -238,5 +297,5 @@ void serial_help_devs() {
 }
 
 int serial_get_status() {
-  return ftdistatus;
+  return __atomic_load_n(&ftdistatus,__ATOMIC_SEQ_CST);
 }
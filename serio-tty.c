@@ -3,12 +3,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <glob.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <pthread.h>
 
-#include <termios.h>
+/* the kernel's termios2, for arbitrary baud rates.  this can't be mixed with
+   the libc termios.h, so everything here goes through ioctl directly. */
+#include <asm/termbits.h>
 
 #include "serio.h"
 #include "aldl-io.h"
@@ -18,70 +24,322 @@
 
 /************ SCOPE *********************************
   Alternate serial driver, uses standard linux dev
-  for non-ftdi devices.
+  for non-ftdi devices, such as cp210x and pl2303
+  cables, or ftdi cables with the ftdi_sio kernel
+  driver loaded.  Also works against a pty.
 ****************************************************/
 
-/* bail with fatal error since driver doesn't work yet. */
-#define SERIAL_DRIVER_BROKEN
-
 /****************GLOBALS****************************************/
 
-int fd; /* file descriptor of serial port */
-struct termios term_old,term_new;
+int ttyfd; /* file descriptor of serial port */
+struct termios2 term_old,term_new;
+
+/* simple connection state status bit, read from any thread */
+byte ttystatus;
+
+/* number of failed io attempts, from either thread */
+int ttyfail;
+
+/* the rx thread reads while the acq thread writes, so io takes this shared,
+   and recovery takes it alone, so the port is never closed under a call in
+   progress on the other thread */
+pthread_rwlock_t ttylock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* storage for serial init string */
+char *ttystr;
+
+/****************FUNCTION DEFS************************************/
+
+/* count a failed io attempt */
+void tty_fail(char *op);
+
+/* a successful io attempt */
+void tty_ok();
+
+/* take ttylock around io, and release it after.  after too many failures,
+   the next io on either thread enters recovery first. */
+void tty_io_begin();
+void tty_io_end();
+
+/* enter recovery mode */
+void tty_recovery();
 
 /****************FUNCTIONS**************************************/
 
 void serial_close() {
-  /* close serial port */
+  if(ttystatus > 0) {
+    ioctl(ttyfd,TCSETS2,&term_old);
+    close(ttyfd);
+    __atomic_store_n(&ttystatus,0,__ATOMIC_SEQ_CST);
+  }
 }
 
 int serial_init(char *port) {
-  #ifdef SERIAL_DRIVER_BROKEN
-  /* this error is fatal. */
-  error(EFATAL,ERROR_SERIAL,"The serial driver doesn't work yet.  Use FTDI.");
+  #ifdef SERIAL_VERBOSE
+  printf("serial_init opening port @ %s with method tty\n",port);
   #endif
 
-  /* open serial port */
-  fd = open(port, O_RDWR | O_NOCTTY);
-  if(fd < 0) { /* failed to open port */ 
+  __atomic_store_n(&ttystatus,0,__ATOMIC_SEQ_CST);
+  __atomic_store_n(&ttyfail,0,__ATOMIC_SEQ_CST);
+  ttystr = port;
+
+  if(port == NULL) {
+    error(EFATAL,ERROR_SERIAL,"No PORT set, the tty driver needs a device "
+                              "such as /dev/ttyUSB0");
+  }
+
+  /* open serial port.  reads never block, serial_read waits with poll */
+  ttyfd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  #ifdef TTY_RETRY_OPEN
+  if(ttyfd < 0 && errno == ENOENT) {
+    fprintf(stderr,"Serial device @ %s isn't connected.  Retrying...\n",port);
+    while(ttyfd < 0 && errno == ENOENT) { /* probably just unplugged */
+      sleep(TTY_RETRY_DELAY);
+      ttyfd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    }
+  }
+  #endif
+  if(ttyfd < 0) { /* failed to open port */
     error(EFATAL,ERROR_SERIAL,"Couldn't open file descriptor for device %s",
           port);
   }
 
-  tcgetattr(fd,&term_old); /* save old attr */
-  bzero(&term_new,sizeof(term_new)); /* clear new struct */
+  if(ioctl(ttyfd,TCGETS2,&term_old) < 0) {
+    error(EFATAL,ERROR_SERIAL,"%s is not a serial device",port);
+  }
+  term_new = term_old;
+
+  /* raw mode, the same as cfmakeraw, with no flow control */
+  term_new.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR |
+                        ICRNL | IXON | IXOFF | IXANY);
+  term_new.c_oflag &= ~OPOST;
+  term_new.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  term_new.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS);
+  term_new.c_cflag |= CS8 | CLOCAL | CREAD;
+  term_new.c_cc[VMIN] = 0;
+  term_new.c_cc[VTIME] = 0;
+
+  /* 8192 isn't a standard rate, so set it as a custom divisor */
+  term_new.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+  term_new.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  term_new.c_ispeed = TTY_BAUD;
+  term_new.c_ospeed = TTY_BAUD;
 
-  /* configure serial device here */
+  if(ioctl(ttyfd,TCSETS2,&term_new) < 0) {
+    error(EFATAL,ERROR_SERIAL,"Couldn't set %i baud raw mode on %s",
+          TTY_BAUD,port);
+  }
+
+  #ifdef SERIAL_VERBOSE
+  /* the driver reports the rate it could actually get */
+  struct termios2 term_got;
+  ioctl(ttyfd,TCGETS2,&term_got);
+  printf("init tty driver appears sucessful, %u baud...\n",term_got.c_ospeed);
+  #endif
 
+  __atomic_store_n(&ttystatus,1,__ATOMIC_SEQ_CST);
   return 1;
 }
 
 void serial_purge() {
-  /* purge all buffers */
+  tty_io_begin();
+  if(ioctl(ttyfd,TCFLSH,TCIOFLUSH) < 0) tty_fail("purge");
+  tty_io_end();
+  #ifdef SERIAL_VERBOSE
+  printf("SERIAL PURGE RX/TX\n");
+  #endif
 }
 
 void serial_purge_rx() {
-  /* purge rx buffer */
+  tty_io_begin();
+  if(ioctl(ttyfd,TCFLSH,TCIFLUSH) < 0) tty_fail("purge");
+  tty_io_end();
+  #ifdef SERIAL_VERBOSE
+  printf("SERIAL PURGE RX\n");
+  #endif
 }
 
 void serial_purge_tx() {
-  /* purge tx buffer */
+  tty_io_begin();
+  if(ioctl(ttyfd,TCFLSH,TCOFLUSH) < 0) tty_fail("purge");
+  tty_io_end();
+  #ifdef SERIAL_VERBOSE
+  printf("SERIAL PURGE TX\n");
+  #endif
 }
 
 int serial_write(byte *str, int len) {
-  /* write string */
-  return 1;
+  #ifdef SERIAL_SUPERVERBOSE
+  printf("WRITE: ");
+  printhexstring(str,len);
+  #endif
+
+  struct pollfd p;
+  int written = 0;
+  int resp;
+  tty_io_begin(); /* before ttyfd is used, recovery may change it */
+  p.fd = ttyfd;
+  p.events = POLLOUT;
+
+  while(written < len) {
+    resp = write(ttyfd,str + written,len - written);
+    if(resp > 0) {
+      written += resp;
+      continue;
+    }
+    if(resp < 0 && errno != EAGAIN && errno != EINTR) break;
+    /* the output buffer is full, wait for it to drain */
+    if(poll(&p,1,TTY_WRITE_TIMEOUT) <= 0) break;
+  }
+  if(written < len) {
+    tty_fail("write");
+  } else {
+    tty_ok();
+  }
+  tty_io_end();
+  return 0;
 }
 
 int serial_read(byte *str, int len) {
-  /* read bytes into str */
-  return 0; /* return number of bytes read, or zero */
+  struct pollfd p;
+  int resp = 0; /* to store response from whatever read */
+  tty_io_begin();
+  p.fd = ttyfd;
+  p.events = POLLIN;
+
+  /* wait a little while for something to arrive, rather than spinning */
+  resp = poll(&p,1,TTY_POLL_TIMEOUT);
+  if(resp > 0 && (p.revents & POLLIN)) {
+    resp = read(ttyfd,str,len);
+    if(resp == 0) { /* end of file after poll, it hung up */
+      resp = -1;
+      errno = EIO;
+    }
+  } else if(resp > 0) { /* POLLERR or POLLHUP, the device went away */
+    resp = -1;
+    errno = EIO;
+  }
+  if(resp < 0) {
+    if(errno != EAGAIN && errno != EINTR) tty_fail("read");
+    resp = 0;
+  } else if(resp > 0) {
+    tty_ok();
+  }
+  tty_io_end();
+  #ifdef SERIAL_SUPERVERBOSE
+  if(resp > 0) {
+    printf("READ %i of %i bytes: ",resp,len);
+    printhexstring(str,resp);
+  } else {
+    printf("EMPTY\n");
+  }
+  #endif
+
+  return resp; /* return number of bytes read, or zero */
+}
+
+int serial_read_until(byte *str, int len, timespec_t deadline) {
+  struct pollfd p;
+  int got = 0;
+  int resp;
+  tty_io_begin();
+  p.fd = ttyfd;
+  p.events = POLLIN;
+
+  while(got < len) {
+    /* sleep in poll until data arrives, rounding the wait up to a whole ms.
+       once the deadline is gone this still checks once without waiting. */
+    resp = poll(&p,1,( get_remaining_us(deadline) + 999 ) / 1000);
+    if(resp == 0) break; /* deadline passed */
+    if(resp < 0) {
+      if(errno == EINTR) continue;
+      tty_fail("read");
+      break;
+    }
+    if(!(p.revents & POLLIN)) { /* POLLERR or POLLHUP */
+      errno = EIO;
+      tty_fail("read");
+      break;
+    }
+    resp = read(ttyfd,str + got,len - got);
+    if(resp == 0) { /* end of file after poll, it hung up */
+      errno = EIO;
+      resp = -1;
+    }
+    if(resp < 0) {
+      if(errno == EAGAIN || errno == EINTR) continue;
+      tty_fail("read");
+      break;
+    }
+    got += resp;
+    tty_ok();
+  }
+  tty_io_end();
+  #ifdef SERIAL_SUPERVERBOSE
+  printf("READ_UNTIL %i of %i bytes: ",got,len);
+  printhexstring(str,got);
+  #endif
+
+  return got;
+}
+
+void tty_fail(char *op) {
+  __atomic_add_fetch(&ttyfail,1,__ATOMIC_SEQ_CST);
+  #ifdef SERIAL_VERBOSE
+  fprintf(stderr,"TTY DRIVER: %s failed, %s\n",op,strerror(errno));
+  #endif
+}
+
+void tty_ok() {
+  __atomic_store_n(&ttyfail,0,__ATOMIC_SEQ_CST);
+}
+
+void tty_io_begin() {
+  /* recover before taking the lock shared, so both threads end up waiting
+     for it here, and neither holds it when recovery runs */
+  if(__atomic_load_n(&ttyfail,__ATOMIC_SEQ_CST) > TTY_MAXFAIL) tty_recovery();
+  pthread_rwlock_rdlock(&ttylock);
+}
+
+void tty_io_end() {
+  pthread_rwlock_unlock(&ttylock);
+}
+
+void tty_recovery() {
+  #ifdef TTY_ATTEMPT_RECOVERY
+  /* waits for the other thread to finish its io, and it may have recovered
+     already by the time this gets the lock */
+  pthread_rwlock_wrlock(&ttylock);
+  if(__atomic_load_n(&ttyfail,__ATOMIC_SEQ_CST) > TTY_MAXFAIL) {
+    #ifdef SERIAL_VERBOSE
+    fprintf(stderr,"TTY DRIVER: Triggered recovery mode...\n");
+    #endif
+    serial_close();
+    msleep(500);
+    serial_init(ttystr);
+  }
+  pthread_rwlock_unlock(&ttylock);
+  #endif
 }
 
 void serial_help_devs() {
-  printf("The tty serial driver doesn't support this command.\n");
+  glob_t g;
+  size_t x;
+  char *patterns[] = { "/dev/serial/by-id/*", "/dev/ttyUSB*", "/dev/ttyACM*",
+                       NULL };
+  int n;
+  int found = 0;
+
+  for(n=0;patterns[n] != NULL;n++) {
+    if(glob(patterns[n],0,NULL,&g) != 0) continue;
+    if(found == 0) printf("Serial devices found, use one as the PORT:\n");
+    for(x=0;x<g.gl_pathc;x++) printf("%s\n",g.gl_pathv[x]);
+    found += g.gl_pathc;
+    globfree(&g);
+  }
+  if(found == 0) printf("No usb serial devices found.\n");
 }
 
 int serial_get_status() {
-  return 0;
+  return __atomic_load_n(&ttystatus,__ATOMIC_SEQ_CST);
 }
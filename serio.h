@@ -3,6 +3,7 @@
 #define _SERIO_H
 
 #include "aldl-types.h"
+#include "useful.h"
 
 /************ SCOPE *********************************
   Each serial module must contain these functions.
@@ -19,6 +20,12 @@ int serial_write(byte *str, int len);
    isn't there. */
 int serial_read(byte *str, int len);
 
+/* read data from the serial port to buf until len bytes have been read, or
+   the deadline (see get_deadline) has passed.  returns the number of bytes
+   read.  drivers wait for data without spinning, and return as soon as the
+   last byte arrives. */
+int serial_read_until(byte *str, int len, timespec_t deadline);
+
 /* clears any i/o buffers */
 void serial_purge(); /* both buffers */
 void serial_purge_rx(); /* rx only */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local objects */
+#include "aldl-types.h"
+#include "aldl-io.h"
+#include "error.h"
+#include "useful.h"
+#include "trigger.h"
+
+/************ SCOPE *********************************
+  Trigger expressions over definitions.  See
+  trigger.h.
+****************************************************/
+
+/* longest token in an expression */
+#define TRIGGER_MAXTOKEN 64
+
+/* copy the next token of an expression into tok and return a pointer past
+   it, or NULL at the end.  a token is either a run of operator characters or
+   a run of anything else that isn't whitespace. */
+char *trigger_token(char *in, char *tok);
+
+/* evaluate one condition against a record */
+int trigger_cond(aldl_conf_t *aldl, trigger_cond_t *c, aldl_record_t *rec,
+                 int primed);
+
+/* 1 if c is an operator character */
+#define TRIGGER_OPCHAR(c) (strchr("<>=!&|",c) != NULL && c != 0)
+
+trigger_t *trigger_compile(aldl_conf_t *aldl, char *expr) {
+  char tok[TRIGGER_MAXTOKEN];
+  char *cursor = expr;
+  char *end;
+  double value;
+  trigger_cond_t *c;
+  trigger_t *t = smalloc(sizeof(trigger_t));
+
+  /* there can't be more conditions than tokens */
+  t->cond = smalloc(sizeof(trigger_cond_t) * (strlen(expr) / 2 + 1));
+  t->n_conds = 0;
+  t->primed = 0;
+
+  while((cursor = trigger_token(cursor,tok)) != NULL) {
+    c = &t->cond[t->n_conds];
+    c->or = (t->n_conds == 0) ? 1 : 0;
+
+    /* a joiner between conditions */
+    if(t->n_conds > 0) {
+      if(rf_strcmp(tok,"||") == 1) {
+        c->or = 1;
+      } else if(rf_strcmp(tok,"&&") != 1) {
+        error(1,ERROR_CONFIG,"trigger: expected && or || before %s in %s",
+              tok,expr);
+      }
+      cursor = trigger_token(cursor,tok);
+      if(cursor == NULL) {
+        error(1,ERROR_CONFIG,"trigger: %s ends with a joiner",expr);
+      }
+    }
+
+    if(rf_strcmp(tok,"ERRORS") == 1) {
+      c->op = TRIGGER_ERRORS;
+      c->def = -1;
+      t->n_conds++;
+      continue;
+    }
+
+    c->def = get_index_by_name(aldl,tok);
+    if(c->def < 0) {
+      error(1,ERROR_CONFIG,"trigger: no definition named %s",tok);
+    }
+
+    cursor = trigger_token(cursor,tok);
+    if(cursor == NULL) {
+      error(1,ERROR_CONFIG,"trigger: %s ends without a comparison",expr);
+    }
+    if(rf_strcmp(tok,"increases") == 1) {
+      c->op = TRIGGER_INCREASES;
+    } else if(rf_strcmp(tok,"decreases") == 1) {
+      c->op = TRIGGER_DECREASES;
+    } else if(rf_strcmp(tok,"changes") == 1) {
+      c->op = TRIGGER_CHANGES;
+    } else {
+      if(rf_strcmp(tok,">") == 1) {
+        c->op = TRIGGER_GT;
+      } else if(rf_strcmp(tok,">=") == 1) {
+        c->op = TRIGGER_GE;
+      } else if(rf_strcmp(tok,"<") == 1) {
+        c->op = TRIGGER_LT;
+      } else if(rf_strcmp(tok,"<=") == 1) {
+        c->op = TRIGGER_LE;
+      } else if(rf_strcmp(tok,"==") == 1) {
+        c->op = TRIGGER_EQ;
+      } else if(rf_strcmp(tok,"!=") == 1) {
+        c->op = TRIGGER_NE;
+      } else {
+        error(1,ERROR_CONFIG,"trigger: unknown comparison %s in %s",tok,expr);
+      }
+      cursor = trigger_token(cursor,tok);
+      if(cursor == NULL) {
+        error(1,ERROR_CONFIG,"trigger: %s ends without a value",expr);
+      }
+      value = strtod(tok,&end);
+      if(end == tok || *end != 0) {
+        error(1,ERROR_CONFIG,"trigger: %s is not a number in %s",tok,expr);
+      }
+      if(aldl->def[c->def].type == ALDL_FLOAT) {
+        c->value.f = value;
+      } else {
+        c->value.i = (int)value;
+      }
+    }
+    t->n_conds++;
+  }
+
+  if(t->n_conds == 0) error(1,ERROR_CONFIG,"trigger: empty expression");
+  return t;
+}
+
+char *trigger_token(char *in, char *tok) {
+  int len = 0;
+  while(*in == ' ' || *in == '\t') in++;
+  if(*in == 0) return NULL;
+  if(TRIGGER_OPCHAR(*in)) {
+    while(TRIGGER_OPCHAR(*in) && len < TRIGGER_MAXTOKEN - 1) {
+      tok[len] = *in;
+      len++;
+      in++;
+    }
+  } else {
+    while(*in != 0 && *in != ' ' && *in != '\t' && !TRIGGER_OPCHAR(*in) &&
+          len < TRIGGER_MAXTOKEN - 1) {
+      tok[len] = *in;
+      len++;
+      in++;
+    }
+  }
+  tok[len] = 0;
+  return in;
+}
+
+int trigger_cond(aldl_conf_t *aldl, trigger_cond_t *c, aldl_record_t *rec,
+                 int primed) {
+  int errs;
+  aldl_data_t v;
+  int result = 0;
+  int isfloat;
+
+  if(c->op == TRIGGER_ERRORS) {
+    return (record_errors(aldl,rec,&errs,1) > 0) ? 1 : 0;
+  }
+
+  v = record_get(aldl,rec,c->def);
+  isfloat = (aldl->def[c->def].type == ALDL_FLOAT) ? 1 : 0;
+  switch(c->op) {
+    case TRIGGER_GT:
+      result = isfloat ? v.f > c->value.f : v.i > c->value.i;
+      break;
+    case TRIGGER_GE:
+      result = isfloat ? v.f >= c->value.f : v.i >= c->value.i;
+      break;
+    case TRIGGER_LT:
+      result = isfloat ? v.f < c->value.f : v.i < c->value.i;
+      break;
+    case TRIGGER_LE:
+      result = isfloat ? v.f <= c->value.f : v.i <= c->value.i;
+      break;
+    case TRIGGER_EQ:
+      result = isfloat ? v.f == c->value.f : v.i == c->value.i;
+      break;
+    case TRIGGER_NE:
+      result = isfloat ? v.f != c->value.f : v.i != c->value.i;
+      break;
+    case TRIGGER_INCREASES:
+      if(primed) result = isfloat ? v.f > c->last.f : v.i > c->last.i;
+      break;
+    case TRIGGER_DECREASES:
+      if(primed) result = isfloat ? v.f < c->last.f : v.i < c->last.i;
+      break;
+    case TRIGGER_CHANGES:
+      if(primed) result = isfloat ? v.f != c->last.f : v.i != c->last.i;
+      break;
+    default:
+      break;
+  }
+  c->last = v;
+  return result;
+}
+
+int trigger_check(trigger_t *t, aldl_conf_t *aldl, aldl_record_t *rec) {
+  int x;
+  int group = 1; /* the current && group is still true */
+  int result = 0;
+  /* every condition is evaluated, so each one's last value stays current */
+  for(x=0;x<t->n_conds;x++) {
+    if(t->cond[x].or == 1 && x > 0) {
+      if(group == 1) result = 1;
+      group = 1;
+    }
+    if(trigger_cond(aldl,&t->cond[x],rec,t->primed) == 0) group = 0;
+  }
+  if(group == 1) result = 1;
+  t->primed = 1;
+  return result;
+}
+
+void trigger_reset(trigger_t *t) {
+  t->primed = 0;
+}
+
+void trigger_free(trigger_t *t) {
+  free(t->cond);
+  free(t);
+}
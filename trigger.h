@@ -0,0 +1,63 @@
+#ifndef _TRIGGER_H
+#define _TRIGGER_H
+
+#include "aldl-types.h"
+
+/************ SCOPE *********************************
+  Trigger expressions over definitions, evaluated
+  once per record, for starting event captures.
+****************************************************/
+
+/* an expression is one or more conditions joined with && and ||, where &&
+   binds tighter.  a condition is one of:
+
+     NAME op VALUE  where op is >, >=, <, <=, == or !=
+     NAME increases
+     NAME decreases
+     NAME changes   compared with the previous record checked
+     ERRORS         any definition marked as an error code is set
+
+   for example "RPM > 5000 && PE == 1 || KNOCK increases". */
+
+typedef enum _trigger_op {
+  TRIGGER_GT = 0,
+  TRIGGER_GE = 1,
+  TRIGGER_LT = 2,
+  TRIGGER_LE = 3,
+  TRIGGER_EQ = 4,
+  TRIGGER_NE = 5,
+  TRIGGER_INCREASES = 6,
+  TRIGGER_DECREASES = 7,
+  TRIGGER_CHANGES = 8,
+  TRIGGER_ERRORS = 9
+} trigger_op_t;
+
+typedef struct _trigger_cond {
+  trigger_op_t op;
+  int def;          /* definition index, unused for TRIGGER_ERRORS */
+  aldl_data_t value; /* the value compared with, of the definition's type */
+  aldl_data_t last;  /* the value in the previous record checked */
+  int or;           /* 1 if this starts a new || group */
+} trigger_cond_t;
+
+typedef struct _trigger {
+  int n_conds;
+  trigger_cond_t *cond;
+  int primed;       /* a record has been checked, so last is valid */
+} trigger_t;
+
+/* compile an expression against the definition set.  a bad expression is a
+   fatal config error. */
+trigger_t *trigger_compile(aldl_conf_t *aldl, char *expr);
+
+/* check a record, returns 1 if the expression is true for it.  records must
+   be checked in order, for the conditions that compare with the previous
+   one. */
+int trigger_check(trigger_t *t, aldl_conf_t *aldl, aldl_record_t *rec);
+
+/* forget the previous record, such as after the connection was lost */
+void trigger_reset(trigger_t *t);
+
+void trigger_free(trigger_t *t);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -32,6 +33,37 @@ unsigned long get_elapsed_ms(timespec_t timestamp) {
   return ( seconds * 1000 ) + milliseconds;
 }
 
+timespec_t get_deadline(int ms) {
+  timespec_t deadline = get_time();
+  deadline.tv_sec += ms / 1000;
+  #ifdef USEFUL_BETTERCLOCK
+  deadline.tv_nsec += ( ms % 1000 ) * 1000000;
+  if(deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  #else
+  deadline.tv_usec += ( ms % 1000 ) * 1000;
+  if(deadline.tv_usec >= 1000000) {
+    deadline.tv_sec++;
+    deadline.tv_usec -= 1000000;
+  }
+  #endif
+  return deadline;
+}
+
+unsigned long get_remaining_us(timespec_t deadline) {
+  timespec_t currenttime = get_time();
+  long seconds = deadline.tv_sec - currenttime.tv_sec;
+  #ifdef USEFUL_BETTERCLOCK
+  long microseconds = (deadline.tv_nsec - currenttime.tv_nsec) / 1000;
+  #else
+  long microseconds = deadline.tv_usec - currenttime.tv_usec;
+  #endif
+  microseconds += seconds * 1000000;
+  return (microseconds > 0) ? microseconds : 0;
+}
+
 byte checksum_generate(byte *buf, int len) {
   #ifdef RETARDED
   retardptr(buf,"checksum buf");
@@ -53,20 +85,52 @@ int checksum_test(byte *buf, int len) {
 int cmp_bytestring(byte *h, int hsize, byte *n, int nsize) {
   if(nsize > hsize) return 0; /* needle is larger than haystack */
   if(hsize < 1 || nsize < 1) return 0;
-  int cursor = 0; /* haystack compare cursor */
-  int matched = 0; /* needle compare cursor */
-  while(cursor <= hsize) {
-    if(nsize == matched) return 1;
-    if(h[cursor] != n[matched]) { /* reset match */
-      matched = 0;
-    } else {
-      matched++;
+  rf_match_t m;
+  int found;
+  rf_match_init(&m,n,nsize);
+  found = (rf_match_feed(&m,h,hsize) > 0) ? 1 : 0;
+  rf_match_free(&m);
+  return found;
+}
+
+void rf_match_init(rf_match_t *m, byte *needle, int len) {
+  int x;
+  int k = 0;
+  m->needle = needle;
+  m->len = len;
+  m->state = 0;
+  if(len <= RF_MATCH_INLINE) {
+    m->fail = m->inlinefail;
+  } else {
+    m->fail = smalloc(sizeof(int) * len);
+  }
+  if(len > 0) m->fail[0] = 0;
+  for(x=1;x<len;x++) {
+    while(k > 0 && needle[x] != needle[k]) k = m->fail[k - 1];
+    if(needle[x] == needle[k]) k++;
+    m->fail[x] = k;
+  }
+}
+
+int rf_match_feed(rf_match_t *m, byte *str, int n) {
+  int x;
+  int k = m->state;
+  for(x=0;x<n;x++) {
+    while(k > 0 && str[x] != m->needle[k]) k = m->fail[k - 1];
+    if(str[x] == m->needle[k]) k++;
+    if(k == m->len) {
+      m->state = 0;
+      return x + 1;
     }
-    cursor++;
   }
+  m->state = k;
   return 0;
 }
 
+void rf_match_free(rf_match_t *m) {
+  if(m->fail != m->inlinefail) free(m->fail);
+}
+
 void printhexstring(byte *str, int length) {
   int x;
   for(x=0;x<length;x++) printf("%X ",(unsigned int)str[x]);
@@ -115,6 +179,48 @@ char rf_listcmp(char *str, char *filter) {
   return 0;
 }
 
+/* FNV-1a string hash */
+unsigned int rf_hash_string(char *str) {
+  unsigned int h = 2166136261u;
+  while(*str != 0) {
+    h ^= (unsigned char)*str;
+    h *= 16777619u;
+    str++;
+  }
+  return h;
+}
+
+rf_hash_t *rf_hash_create(unsigned int n) {
+  rf_hash_t *h = smalloc(sizeof(rf_hash_t));
+  /* keep load factor under 50% so probe chains stay short */
+  h->size = 16;
+  while(h->size < n * 2) h->size *= 2;
+  h->key = smalloc(sizeof(char *) * h->size);
+  memset(h->key,0,sizeof(char *) * h->size);
+  h->value = smalloc(sizeof(int) * h->size);
+  return h;
+}
+
+int rf_hash_insert(rf_hash_t *h, char *key, int value) {
+  unsigned int b = rf_hash_string(key) & ( h->size - 1 );
+  while(h->key[b] != NULL) { /* linear probe */
+    if(strcmp(h->key[b],key) == 0) return h->value[b];
+    b = ( b + 1 ) & ( h->size - 1 );
+  }
+  h->key[b] = key;
+  h->value[b] = value;
+  return -1;
+}
+
+int rf_hash_get(rf_hash_t *h, char *key) {
+  unsigned int b = rf_hash_string(key) & ( h->size - 1 );
+  while(h->key[b] != NULL) {
+    if(strcmp(h->key[b],key) == 0) return h->value[b];
+    b = ( b + 1 ) & ( h->size - 1 );
+  }
+  return -1;
+}
+
 int rf_clamp_int(int min, int max, int in) {
   if(in > max) return max;
   if(in < min) return min;
@@ -127,6 +233,76 @@ float rf_clamp_float(float min, float max, float in) {
   return in;
 }
 
+int rf_ultoa(char *buf, unsigned long in) {
+  char tmp[20]; /* digits in reverse */
+  int len = 0;
+  int x = 0;
+  do {
+    tmp[x++] = '0' + in % 10;
+    in /= 10;
+  } while(in != 0);
+  while(x > 0) buf[len++] = tmp[--x];
+  buf[len] = 0;
+  return len;
+}
+
+int rf_itoa(char *buf, int in) {
+  unsigned int u = in;
+  if(in < 0) {
+    buf[0] = '-';
+    u = -u; /* well defined for INT_MIN as unsigned */
+    return rf_ultoa(buf + 1,u) + 1;
+  }
+  return rf_ultoa(buf,u);
+}
+
+/* powers of ten for rf_ftoa */
+static const unsigned long long rf_pow10[] = { 1, 10, 100, 1000, 10000,
+            100000, 1000000, 10000000, 100000000, 1000000000 };
+
+int rf_ftoa(char *buf, float in, int precision) {
+  double d = in;
+  double scaled;
+  double frac;
+  unsigned long long q, ipart, fpart;
+  int len = 0;
+  int x;
+
+  /* nan, inf and anything whose scaled value won't fit exactly in a double
+     goes the slow way */
+  if(precision < 0 || precision > 9 || !(d > -1e9 && d < 1e9)) {
+    return sprintf(buf,"%.*f",precision,d);
+  }
+
+  if(__builtin_signbit(d)) {
+    buf[len++] = '-'; /* printf keeps the sign of anything that rounds to 0 */
+    d = -d;
+  }
+
+  /* a float has 24 significant bits and 10^9 needs 30, so this product is
+     exact, and so is the fraction split off below.  rounding the exact value
+     half to even is what glibc printf does. */
+  scaled = d * rf_pow10[precision];
+  q = (unsigned long long)scaled;
+  frac = scaled - q;
+  if(frac > 0.5 || (frac == 0.5 && (q & 1) == 1)) q++;
+
+  ipart = q / rf_pow10[precision];
+  fpart = q % rf_pow10[precision];
+
+  len += rf_itoa(buf + len,ipart); /* ipart is below 1e9 */
+  if(precision > 0) {
+    buf[len++] = '.';
+    for(x=precision-1;x>=0;x--) {
+      buf[len + x] = '0' + fpart % 10;
+      fpart /= 10;
+    }
+    len += precision;
+  }
+  buf[len] = 0;
+  return len;
+}
+
 int rf_chfilter(char *str, char *filter, char repl) {
   int x = 0;
   int y = 0;
@@ -38,6 +38,12 @@ timespec_t get_time();
 /* get the difference between the current time and the timestamp */
 unsigned long get_elapsed_ms(timespec_t timestamp);
 
+/* get a deadline ms milliseconds from now */
+timespec_t get_deadline(int ms);
+
+/* microseconds left until a deadline, or 0 if it has passed */
+unsigned long get_remaining_us(timespec_t deadline);
+
 /* convert a 0xFF format string to a 'byte'... */
 #define hextobyte(STR) (int)strtol(STR,NULL,16)
 
@@ -59,6 +65,34 @@ int checksum_test(byte *buf, int len);
 /* compare a byte string n(eedle) in h(aystack), nonzero if found */
 int cmp_bytestring(byte *h, int hsize, byte *n, int nsize);
 
+/* an incremental matcher for a byte string in a stream, that carries its
+   state across chunks and looks at each byte once (knuth-morris-pratt), so
+   partial and overlapping matches split between reads are never missed. */
+
+/* needles up to this long keep their table in the matcher itself, so a
+   matcher for an aldl message on the stack never touches the heap */
+#define RF_MATCH_INLINE 16
+
+typedef struct _rf_match_t {
+  byte *needle;
+  int len;
+  int *fail;  /* for each prefix of needle, the length of its longest proper
+                 prefix that's also a suffix, where matching resumes */
+  int state;  /* bytes of needle matched at the end of the stream so far */
+  int inlinefail[RF_MATCH_INLINE]; /* fail for short needles */
+} rf_match_t;
+
+/* set up a matcher for needle, which must outlive it */
+void rf_match_init(rf_match_t *m, byte *needle, int len);
+
+/* feed the next n bytes of the stream.  returns the number of bytes used up
+   to and including the end of the first match, or 0 if there's no match
+   yet.  after a match, the matcher starts over. */
+int rf_match_feed(rf_match_t *m, byte *str, int n);
+
+/* free the matcher's table if it was allocated, not the matcher itself */
+void rf_match_free(rf_match_t *m);
+
 /* print a string of bytes in hex format */
 void printhexstring(byte *str, int length);
 
@@ -80,6 +114,40 @@ char rf_listcmp(char *str, char *filter);
    filtering 'bad' chars from a string.  return number of chars replaced. */
 int rf_chfilter(char *str, char *filter, char repl);
 
+/* --- NUMBER FORMATTING -------------- */
+
+/* write an int in decimal, like sprintf %i.  returns the length, not
+   including the null terminator. */
+int rf_itoa(char *buf, int in);
+
+/* same as rf_itoa, for an unsigned long, like sprintf %lu */
+int rf_ultoa(char *buf, unsigned long in);
+
+/* write a float with a fixed number of decimal places, byte-identical to
+   sprintf %.*f but without the generic printf machinery.  precision may be
+   0-9.  returns the length, not including the null terminator. */
+int rf_ftoa(char *buf, float in, int precision);
+
+/* --- HASH INDEX ---------------------- */
+
+/* a fixed size string-keyed index, for lookups by name.  keys are not
+   copied, so they must outlive the index. */
+typedef struct _rf_hash_t {
+  unsigned int size; /* number of buckets, always a power of two */
+  char **key;        /* key for each bucket, or NULL if empty */
+  int *value;        /* value for each bucket */
+} rf_hash_t;
+
+/* create an empty index with room for at least n keys */
+rf_hash_t *rf_hash_create(unsigned int n);
+
+/* add a key to the index.  if the key already exists, the original is kept
+   and its value is returned, otherwise returns -1. */
+int rf_hash_insert(rf_hash_t *h, char *key, int value);
+
+/* get the value for a key, or -1 if not found */
+int rf_hash_get(rf_hash_t *h, char *key);
+
 /* --- MATH ---------------------------- */
 
 /* clamp an int or float */